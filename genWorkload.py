@@ -0,0 +1,282 @@
+import argparse
+import random
+import sys
+
+# 合成负载生成器：输出 Memory 能直接读入的 @addr hex 文本，程序结束时 a0 为校验和
+# 一次循环迭代由以下几部分拼成，各部分的数量与形状都可以调：
+#   ALU 依赖链：chain 条指令依次依赖上一条，共 alu 条
+#   store：写当前地址，地址每次前进 stride，在 footprint 内回绕；stride 小时紧随其后的 load 会读到刚写的数据
+#   load：每个 load 之后隔 load_use 条无关指令才使用结果，地址同样前进
+#   分支：一个周期为 period 的位模式决定跳不跳，taken_rate 为其中跳转的比例，1 的位置随机但固定
+#   无关指令填充到 code_size 条
+# 另有一个向量核 (generate_kernel)：y[i] += x[i] << 2，标量与 RVV 两种写法结果相同，用来测向量单元的加速比
+
+CODE_BASE = 0x0
+DATA_BASE = 0x20000
+DATA_LIMIT = 0x40000  # footprint 上限，DATA_BASE + DATA_LIMIT 不超过模拟器的 MEM_SIZE
+
+kernel_defaults = {
+    'elements': 256,  # x, y 各多少个字
+    'passes': 4,  # 整个数组算几遍
+    'vector': 1,  # 0: 标量循环, 1: RVV 分段 (strip-mining) 循环
+}
+
+defaults = {
+    'iterations': 2000,
+    'alu': 8,
+    'chain': 1,
+    'loads': 2,
+    'load_use': 2,
+    'stores': 1,
+    'stride': 4,
+    'footprint': 4096,
+    'branches': 1,
+    'taken_rate': 0.5,
+    'period': 2,
+    'code_size': 0,
+}
+
+ZERO, RA, SP = 0, 1, 2
+T = [5, 6, 7, 28, 29, 30, 31]
+S = [8, 9, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27]
+A = [10, 11, 12, 13, 14, 15, 16, 17]
+
+ITER, BASE, OFFSET, STRIDE, MASK, PATTERN = S[0], S[1], S[2], S[3], S[4], S[5]
+LOAD_REGS = S[6:]  # load 结果轮流写这些寄存器
+CHAIN_REGS = T[:3]  # ALU 依赖链
+ADDR, TEST = T[3], T[4]  # 当前地址, 分支条件
+ACC = A[0]  # 校验和
+FILL_REGS = A[1:]  # 无关指令只写不读
+
+
+def r_type(f7, rs2, rs1, f3, rd, op):
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op
+
+
+def i_type(imm, rs1, f3, rd, op):
+    return ((imm & 0xfff) << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op
+
+
+def s_type(imm, rs2, rs1, f3):
+    imm &= 0xfff
+    return ((imm >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | ((imm & 31) << 7) | 0b0100011
+
+
+def b_type(imm, rs2, rs1, f3):
+    imm &= 0x1fff
+    return (((imm >> 12) & 1) << 31) | (((imm >> 5) & 63) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) \
+        | (((imm >> 1) & 15) << 8) | (((imm >> 11) & 1) << 7) | 0b1100011
+
+
+def j_type(imm, rd):
+    imm &= 0x1fffff
+    return (((imm >> 20) & 1) << 31) | (((imm >> 1) & 0x3ff) << 21) | (((imm >> 11) & 1) << 20) \
+        | (((imm >> 12) & 0xff) << 12) | (rd << 7) | 0b1101111
+
+
+def lui(rd, imm): return (imm & 0xfffff000) | (rd << 7) | 0b0110111
+def addi(rd, rs1, imm): return i_type(imm, rs1, 0b000, rd, 0b0010011)
+def andi(rd, rs1, imm): return i_type(imm, rs1, 0b111, rd, 0b0010011)
+def slli(rd, rs1, sh): return i_type(sh, rs1, 0b001, rd, 0b0010011)
+def srli(rd, rs1, sh): return i_type(sh, rs1, 0b101, rd, 0b0010011)
+def add(rd, rs1, rs2): return r_type(0, rs2, rs1, 0b000, rd, 0b0110011)
+def xor(rd, rs1, rs2): return r_type(0, rs2, rs1, 0b100, rd, 0b0110011)
+def or_(rd, rs1, rs2): return r_type(0, rs2, rs1, 0b110, rd, 0b0110011)
+def and_(rd, rs1, rs2): return r_type(0, rs2, rs1, 0b111, rd, 0b0110011)
+def lw(rd, rs1, imm): return i_type(imm, rs1, 0b010, rd, 0b0000011)
+def sw(rs2, rs1, imm): return s_type(imm, rs2, rs1, 0b010)
+def beq(rs1, rs2, imm): return b_type(imm, rs2, rs1, 0b000)
+def bne(rs1, rs2, imm): return b_type(imm, rs2, rs1, 0b001)
+def jal(rd, imm): return j_type(imm, rd)
+def sub(rd, rs1, rs2): return r_type(0b0100000, rs2, rs1, 0b000, rd, 0b0110011)
+
+
+# RVV 子集 (e32, LMUL=1, 不带掩码)
+def op_v(f6, f3, vd, x, vs2): return (f6 << 26) | (1 << 25) | (vs2 << 20) | ((x & 31) << 15) | (f3 << 12) | (vd << 7) | 0b1010111
+def vsetvli(rd, rs1): return (0b010000 << 20) | (rs1 << 15) | (0b111 << 12) | (rd << 7) | 0b1010111  # e32, m1
+def vle32(vd, rs1): return (1 << 25) | (rs1 << 15) | (0b110 << 12) | (vd << 7) | 0b0000111
+def vse32(vs3, rs1): return (1 << 25) | (rs1 << 15) | (0b110 << 12) | (vs3 << 7) | 0b0100111
+def vadd_vv(vd, vs2, vs1): return op_v(0b000000, 0b000, vd, vs1, vs2)
+def vsll_vi(vd, vs2, imm): return op_v(0b100101, 0b011, vd, imm, vs2)
+def vmv_v_i(vd, imm): return op_v(0b010111, 0b011, vd, imm, 0)
+def vredsum_vs(vd, vs2, vs1): return op_v(0b000000, 0b010, vd, vs1, vs2)
+def vmv_x_s(rd, vs2): return op_v(0b010000, 0b010, rd, 0, vs2)
+
+
+HALT = 0x0ff00513  # 模拟器约定的停机指令
+
+
+def li(rd, value):  # 32 位常数：lui + addi
+    value &= 0xffffffff
+    lo = value & 0xfff
+    if lo >= 0x800:
+        lo -= 0x1000
+    hi = (value - lo) & 0xffffffff
+    if not hi:
+        return [addi(rd, ZERO, lo)]
+    return [lui(rd, hi), addi(rd, rd, lo)]
+
+
+def pattern_bits(taken_rate, period):  # period 位里随机（固定种子）放 round(taken_rate * period) 个 1
+    k = int(round(taken_rate * period))
+    bits = 0
+    for i in random.Random(period).sample(range(period), k):
+        bits |= 1 << i
+    return bits
+
+
+def check(p):
+    if p['iterations'] < 1:
+        raise ValueError('iterations must be positive')
+    if p['chain'] < 1:
+        raise ValueError('chain must be positive')
+    if not 1 <= p['period'] <= 32:
+        raise ValueError('period must be in [1, 32]')
+    if not 0 <= p['taken_rate'] <= 1:
+        raise ValueError('taken_rate must be in [0, 1]')
+    fp = p['footprint']
+    if fp < 8 or fp > DATA_LIMIT or fp & (fp - 1):
+        raise ValueError('footprint must be a power of two in [8, %d]' % DATA_LIMIT)
+    if p['stride'] % 4:
+        raise ValueError('stride must be a multiple of 4')
+
+
+class Body:  # 循环体，fill 产生互不依赖的指令
+    def __init__(self):
+        self.code = []
+        self.fills = 0
+
+    def emit(self, *words):
+        self.code.extend(words)
+
+    def fill(self, n=1):
+        for _ in range(n):
+            self.emit(addi(FILL_REGS[self.fills % len(FILL_REGS)], ZERO, self.fills & 0x7ff))
+            self.fills += 1
+
+
+def generate(**kwargs):  # 返回指令字列表，从 CODE_BASE 开始
+    p = dict(defaults)
+    p.update(kwargs)
+    check(p)
+
+    head = []
+    head += li(ITER, p['iterations'])
+    head += li(BASE, DATA_BASE)
+    head += [addi(OFFSET, ZERO, 0)]
+    head += li(STRIDE, p['stride'])
+    head += li(MASK, (p['footprint'] - 1) & ~3)
+    head += li(PATTERN, pattern_bits(p['taken_rate'], p['period']))
+    head += [addi(ACC, ZERO, 0)] + [addi(r, ZERO, i + 1) for i, r in enumerate(CHAIN_REGS)]
+
+    body = Body()
+    # ALU 依赖链
+    for i in range(p['alu']):
+        reg = CHAIN_REGS[i // p['chain'] % len(CHAIN_REGS)]
+        body.emit(addi(reg, reg, 1) if i % 2 else xor(reg, reg, ITER))
+    # load / store，地址 = BASE + OFFSET
+    for i in range(p['stores']):
+        body.emit(add(ADDR, BASE, OFFSET), sw(ITER, ADDR, 0))
+        body.emit(add(OFFSET, OFFSET, STRIDE), and_(OFFSET, OFFSET, MASK))
+    for i in range(p['loads']):
+        dst = LOAD_REGS[i % len(LOAD_REGS)]
+        body.emit(add(ADDR, BASE, OFFSET), lw(dst, ADDR, 0))
+        body.fill(p['load_use'])
+        body.emit(add(ACC, ACC, dst))
+        body.emit(add(OFFSET, OFFSET, STRIDE), and_(OFFSET, OFFSET, MASK))
+    # 分支：第 j 个分支看模式的第 j 位，模式每次迭代循环右移一位
+    for j in range(p['branches']):
+        body.emit(srli(TEST, PATTERN, j % p['period']), andi(TEST, TEST, 1), bne(TEST, ZERO, 8))
+        body.fill()
+    if p['branches']:
+        body.emit(andi(TEST, PATTERN, 1), srli(PATTERN, PATTERN, 1))
+        body.emit(slli(TEST, TEST, p['period'] - 1), or_(PATTERN, PATTERN, TEST))
+    body.fill(max(0, p['code_size'] - len(body.code) - 2))
+
+    loop = len(head)
+    code = head + body.code
+    code.append(addi(ITER, ITER, -1))
+    back = (loop - len(code)) * 4
+    if back >= -4096:
+        code.append(bne(ITER, ZERO, back))
+    else:  # 超出分支的范围
+        code.append(beq(ITER, ZERO, 8))
+        code.append(jal(ZERO, back - 4))
+    for r in CHAIN_REGS:
+        code.append(add(ACC, ACC, r))
+    code += [addi(ZERO, ZERO, 0)] * 3  # HALT 在 EX 就停机，等 a0 写回
+    code.append(HALT)
+    if len(code) * 4 > DATA_BASE - CODE_BASE:
+        raise ValueError('code_size too large')
+    return code
+
+
+def generate_kernel(**kwargs):  # 返回 (指令字列表, DATA_BASE 开始的数据字列表)
+    p = dict(kernel_defaults)
+    p.update(kwargs)
+    n = p['elements']
+    if n < 1 or 8 * n > DATA_LIMIT:
+        raise ValueError('elements must be in [1, %d]' % (DATA_LIMIT // 8))
+    if p['passes'] < 1:
+        raise ValueError('passes must be positive')
+    X, Y, P, Q, N, VL, OFF = S[1], S[2], S[3], S[4], S[5], T[0], T[1]
+    V_X, V_Y, V_ACC = 1, 2, 4
+
+    code = li(X, DATA_BASE) + li(Y, DATA_BASE + 4 * n) + li(ITER, p['passes']) + [addi(ACC, ZERO, 0)]
+    if p['vector']:
+        code += [vsetvli(VL, ZERO), vmv_v_i(V_ACC, 0)]
+    outer = len(code)
+    code += [addi(P, X, 0), addi(Q, Y, 0)] + li(N, n)
+    inner = len(code)
+    if p['vector']:  # 每次处理 vl 个元素，vl 由 vsetvli 按剩余元素数给出
+        code += [vsetvli(VL, N), vle32(V_X, P), vle32(V_Y, Q), vsll_vi(V_X, V_X, 2), vadd_vv(V_Y, V_Y, V_X), vse32(V_Y, Q),
+                 vredsum_vs(V_ACC, V_Y, V_ACC), slli(OFF, VL, 2), add(P, P, OFF), add(Q, Q, OFF), sub(N, N, VL)]
+    else:
+        code += [lw(T[2], P, 0), lw(T[3], Q, 0), slli(T[2], T[2], 2), add(T[3], T[3], T[2]), sw(T[3], Q, 0),
+                 add(ACC, ACC, T[3]), addi(P, P, 4), addi(Q, Q, 4), addi(N, N, -1)]
+    code.append(bne(N, ZERO, (inner - len(code)) * 4))
+    code.append(addi(ITER, ITER, -1))
+    code.append(bne(ITER, ZERO, (outer - len(code)) * 4))
+    if p['vector']:
+        code.append(vmv_x_s(ACC, V_ACC))
+    code += [addi(ZERO, ZERO, 0)] * 3
+    code.append(HALT)
+    data = [i + 1 for i in range(n)] + [(7 * i) & 0xffff for i in range(n)]
+    return code, data
+
+
+def to_hex(code, base=CODE_BASE, data=None):
+    lines = ['@%08X' % base]
+    for w in code:
+        lines.append(' '.join('%02X' % ((w >> (8 * k)) & 255) for k in range(4)))
+    if data:
+        lines.append('@%08X' % DATA_BASE)
+        for w in data:
+            lines.append(' '.join('%02X' % ((w >> (8 * k)) & 255) for k in range(4)))
+    return '\n'.join(lines) + '\n'
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='generate a synthetic RV32I workload in @addr hex format')
+    for key, value in defaults.items():
+        parser.add_argument('--' + key.replace('_', '-'), type=type(value), default=value)
+    parser.add_argument('--kernel', action='store_true', help='generate the vector kernel instead (only the options below apply)')
+    for key, value in kernel_defaults.items():
+        if key not in defaults:
+            parser.add_argument('--' + key.replace('_', '-'), type=type(value), default=value)
+    parser.add_argument('-o', '--output', help='output file, stdout by default')
+    args = vars(parser.parse_args())
+    output = args.pop('output')
+    try:
+        if args.pop('kernel'):
+            code, data = generate_kernel(**{k: args[k] for k in kernel_defaults})
+            text = to_hex(code, data=data)
+        else:
+            text = to_hex(generate(**{k: args[k] for k in defaults}))
+    except ValueError as e:
+        sys.exit('genWorkload: ' + str(e))
+    if output:
+        with open(output, 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
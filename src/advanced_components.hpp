@@ -6,6 +6,9 @@
 #define RISC_V_SIMULATOR_ADVANCED_COMPONENTS_HPP
 
 #include "include.hpp"
+#include "basic_components.hpp"
+#include <type_traits>
+#include <cstdint>
 
 namespace RISC_V {
     namespace ADVANCED {
@@ -13,21 +16,58 @@ namespace RISC_V {
             AT, ANT, BHT, TWOLEVEL
         };
 
+        /*
+         * 状态按位压缩：BHT 每个两位饱和计数器只占 2 bit，PHT 的历史只用刚好够 N 位的整数类型
+         * pc 的低两位恒为 0，不参与索引，因此只有 2^(BIT-2) 条历史。
+         * 同一 pc 的 2^N 个计数器连续存放，N<=8 时不超过 64 字节且按其大小对齐，一次预测不会跨 cache line。
+         * CPU 在堆上分配时 C++14 的 new 不保证 alignas 的超对齐，所以 BHT 多留一条 cache line，从中手工取 64 字节对齐的起点
+         * <12, 6> 时 BHT 16KB + PHT 1KB，原先 uint32_t 存储为 272KB
+         */
         template<size_t BIT = 12, size_t N = 2> //N=6 best for superloop
         class BranchPredictor {
         private:
+            static_assert(BIT > 2 && N > 0 && N <= 32, "bad predictor size");
+            typedef typename std::conditional<(N <= 8), uint8_t, typename std::conditional<(N <= 16), uint16_t, uint32_t>::type>::type History;
+            static const size_t PCS = 1 << (BIT - 2), COUNTERS = PCS << N;
+            static const uint32_t HISTORY_MASK = uint32_t((uint64_t(1) << N) - 1);
+            static const size_t LINE = 64, BHT_BYTES = (COUNTERS + 3) / 4;
+
             PredictorType type;
+            size_t nowpos; //predict 时算出的计数器位置，update 直接使用
+            size_t base; //bht 中第一个 64 字节对齐的位置，构造时算好
+            uint8_t bht[BHT_BYTES + LINE - 1]; //每字节 4 个计数器，实际使用 base 起的 BHT_BYTES 字节
+            History pht[PCS];
+
+            uint32_t counter(size_t pos) const { return (bht[base + (pos >> 2)] >> ((pos & 3) << 1)) & 3; }
+
+            void setCounter(size_t pos, uint32_t val) {
+                uint8_t& b = bht[base + (pos >> 2)];
+                b = uint8_t((b & ~(3 << ((pos & 3) << 1))) | (val << ((pos & 3) << 1)));
+            }
+
+            size_t index() const { //BHT: 每个 pc 一个计数器; TWOLEVEL: 每个 pc 2^N 个, 由历史选择
+                size_t entry = nowpc >> 2;
+                return type == TWOLEVEL ? (entry << N) + pht[entry] : entry;
+            }
+
         public:
             int wrong, success, nowpc;
 
-            uint32_t bht[1 << (BIT + N - 2)], table[4][2]; //00, 01, 10, 11
-            uint32_t pht[1 << BIT];
+            uint32_t table[4][2]; //00, 01, 10, 11
 
-            explicit BranchPredictor(PredictorType _type) : type(_type), wrong(0), success(0) {
+            explicit BranchPredictor(PredictorType _type) : type(_type), base((LINE - reinterpret_cast<uintptr_t>(bht) % LINE) % LINE) {
                 table[0][0] = 0, table[0][1] = 1;
                 table[1][0] = 2, table[1][1] = 3;
                 table[2][0] = 0, table[2][1] = 1;
                 table[3][0] = 2, table[3][1] = 3;
+                reset();
+            }
+
+            BranchPredictor(const BranchPredictor&) = delete; //base 只对本对象的地址成立，不能按成员复制
+            BranchPredictor& operator = (const BranchPredictor&) = delete;
+
+            void reset() { //清空历史与计数
+                wrong = success = nowpc = 0, nowpos = 0;
                 memset(bht, 0, sizeof(bht));
                 memset(pht, 0, sizeof(pht));
             }
@@ -40,19 +80,18 @@ namespace RISC_V {
                     case ANT:
                         return false;
                     case BHT:
-                        return bht[nowpc] > 1; //00 01, failure
+                        return counter(nowpos = index()) > 1; //00 01, failure
                     case TWOLEVEL:
-                        return bht[(nowpc << (N - 2)) + slice(pht[nowpc], 0, N - 1)];
+                        return counter(nowpos = index());
                 }
                 return false;
             }
 
             void update(bool isJump = false) {
-                if (type == BHT) bht[nowpc] = table[bht[nowpc]][isJump];
-                else if (type == TWOLEVEL) {
-                    uint32_t tar = (nowpc << (N - 2)) + slice(pht[nowpc], 0, N - 1);
-                    bht[tar] = table[bht[tar]][isJump];
-                    pht[nowpc] = (pht[nowpc] << 1) | isJump;
+                if (type == BHT || type == TWOLEVEL) setCounter(nowpos, table[counter(nowpos)][isJump]);
+                if (type == TWOLEVEL) {
+                    History& h = pht[nowpc >> 2];
+                    h = History(((h << 1) | isJump) & HISTORY_MASK);
                 }
                 nowpc = 0;
             }
@@ -99,7 +138,7 @@ namespace RISC_V {
                 EXBypassRd[0] = EXBypassVal[0] = EXBypassRd[1] = EXBypassVal[1] = MEMBypassRd[0] = MEMBypassVal[0] = MEMBypassRd[1] = MEMBypassVal[1] = 0;
             }
 
-            void display() {
+            void display() const {
                 std::cout << "EXOld: " << EXBypassRd[0] << ' ' << EXBypassVal[0] << ' ';
                 std::cout << "MEMOld: " << MEMBypassRd[0] << ' ' << MEMBypassVal[0] << '\n';
                 std::cout << "EXNew: " << EXBypassRd[1] << ' ' << EXBypassVal[1] << ' ';
@@ -107,15 +146,161 @@ namespace RISC_V {
             }
         };
 
+        /*
+         * ID 阶段的分支比较器：条件分支 (含融合的 CMPBR) 用 ID 读到的 A、B 直接比较，不必等到 EX。
+         * ID 的操作数本来就经过旁路，并且已按数据冒险停顿过：EX 的结果等一周期从旧槽位取，load 等到 MEM 之后，
+         * 所以冒险检测通过的那一拍操作数就是最终值，当拍即可确定跳不跳。
+         * 预测错误时只需冲掉 IF 取的一条，不再冲掉 IF_ID、ID、ID_EX。
+         * 自带一个 ALU，与 EX 的比较结果完全一致，也不占用 ID 计算目标地址的 ALU
+         */
+        class BranchComparator {
+        private:
+            BASIC::ALU alu;
+        public:
+            bool enabled;
+            size_t resolved, mispredicts, penalty; //penalty: 预测错误时实际冲掉的错误路径指令数，两种方式都统计
+
+            explicit BranchComparator(bool _enabled = false) : enabled(_enabled), resolved(0), mispredicts(0), penalty(0) {}
+
+            bool taken(const Instruction& ir, uint32_t A, uint32_t B) {
+                switch (ir.ins) {
+                    case BEQ: alu.input(A, B, '-'); return alu.zero;
+                    case BNE: alu.input(A, B, '-'); return !alu.zero;
+                    case BLT: alu.input(A, B, '-'); return alu.neg;
+                    case BGE: alu.input(A, B, '-'); return !alu.neg;
+                    case BLTU: alu.input(A, B, '-', false); return alu.neg;
+                    case BGEU: alu.input(A, B, '-', false); return !alu.neg;
+                    case CMPBR: alu.input(A, B, '-', !(ir.funct3 & 1)); return alu.neg != bool(ir.funct3 & 2);
+                    default: return false;
+                }
+            }
+
+            void mispredict(size_t squashed) { mispredicts++, penalty += squashed; }
+
+            void display() {
+                std::cout << "* Branch Resolve *" << '\n';
+                std::cout << "Resolved In:" << (enabled ? "ID" : "EX") << ", Early Resolved:" << resolved
+                          << ", Mispredict Penalty:" << penalty << " squashed (" << (mispredicts ? 1.0 * penalty / mispredicts : 0) << " per mispredict)" << '\n';
+            }
+        };
+
+        enum MemoryModelType {BLOCKING, NONBLOCKING};
+        const size_t MEM_LATENCY = 3; //一次内存访问的周期数
+
+        /*
+         * 写缓冲：store 在 MEM 阶段放进缓冲即可离开，缓冲在后台按 MEM_LATENCY 逐项写回
+         * 内存数组本身在 MEM 阶段就已更新，这里只记录地址用于计时和 store-to-load forwarding 的判断
+         */
+        template<size_t SIZE = 8>
+        class StoreBuffer {
+        private:
+            struct Entry {
+                uint32_t addr, bytes;
+                size_t done; //写回完成的周期
+            };
+            Entry buf[SIZE];
+            size_t head, cnt;
+        public:
+            size_t buffered, forwarded, blocked;
+
+            StoreBuffer() : head(0), cnt(0), buffered(0), forwarded(0), blocked(0) {}
+
+            bool full() const { return cnt == SIZE; }
+
+            void push(uint32_t addr, uint32_t bytes, size_t now) {
+                size_t start = cnt ? std::max(now, buf[(head + cnt - 1) % SIZE].done) : now;
+                buf[(head + cnt) % SIZE] = {addr, bytes, start + MEM_LATENCY};
+                cnt++, buffered++;
+            }
+
+            void drain(size_t now) {
+                while (cnt && buf[head].done <= now) head = (head + 1) % SIZE, cnt--;
+            }
+
+            int lookup(uint32_t addr, uint32_t bytes) const { //从新到旧找第一个重叠的 store: 1 完全覆盖, -1 部分重叠, 0 无
+                for (size_t i = cnt; i > 0; --i) {
+                    const Entry& e = buf[(head + i - 1) % SIZE];
+                    if (addr + bytes <= e.addr || e.addr + e.bytes <= addr) continue;
+                    return (e.addr <= addr && addr + bytes <= e.addr + e.bytes) ? 1 : -1;
+                }
+                return 0;
+            }
+
+            void clear() { head = cnt = 0; }
+
+            void display() {
+                std::cout << "* Store Buffer *" << '\n';
+                std::cout << "Buffered:" << buffered << ", Forwarded Loads:" << forwarded << ", Blocked:" << blocked << '\n';
+            }
+        };
+
+        /*
+         * 读队列：未命中写缓冲的 load 在 MEM 阶段发出后即离开，结果 MEM_LATENCY 周期后才算返回
+         * 用到其 rd 的指令在 ID 阶段等待，其余指令照常流动
+         */
+        template<size_t SIZE = 4>
+        class LoadQueue {
+        private:
+            struct Entry {
+                uint32_t rd;
+                size_t ready; //可以在 ID 读到结果的最早周期
+            };
+            Entry buf[SIZE];
+            size_t cnt;
+        public:
+            size_t issued, waitCycles;
+
+            LoadQueue() : cnt(0), issued(0), waitCycles(0) {}
+
+            bool full() const { return cnt == SIZE; }
+
+            void push(uint32_t rd, size_t ready) {
+                if (!rd) return;
+                cancel(rd);
+                buf[cnt++] = {rd, ready};
+                issued++;
+            }
+
+            void retire(size_t now) {
+                for (size_t i = 0; i < cnt;)
+                    if (buf[i].ready <= now) buf[i] = buf[--cnt];
+                    else ++i;
+            }
+
+            void cancel(uint32_t rd) { //更新的指令会覆盖 rd (WAW)，之后读 rd 的指令不必再等这个 load
+                for (size_t i = 0; i < cnt;)
+                    if (buf[i].rd == rd) buf[i] = buf[--cnt];
+                    else ++i;
+            }
+
+            bool pending(const Instruction& ir, size_t tick) const { //在 tick 周期译码的 ir 是否还读不到结果
+                for (size_t i = 0; i < cnt; ++i)
+                    if (buf[i].ready > tick && readsReg(ir, buf[i].rd)) return true;
+                return false;
+            }
+
+            void clear() { cnt = 0; }
+
+            void display() {
+                std::cout << "* Load Queue *" << '\n';
+                std::cout << "Issued:" << issued << ", Wait Cycles:" << waitCycles << '\n';
+            }
+        };
+
         template<size_t SIZE = 16>
         class ICache {
         private:
             uint32_t cache[SIZE<<2], pc;
         public:
+            static const uint32_t LINE = SIZE<<2; //一行的字节数
+
+            static uint32_t line(uint32_t addr) {return addr & ~(LINE - 1);}
+
             ICache():pc(SIZE<<2) {}
-            void load(uint32_t* tar) {
-                memcpy(cache, tar, sizeof(cache));
-                pc = 0;
+            void load(const uint32_t* pool, uint32_t addr) { //载入 addr 所在的对齐行
+                uint32_t base = line(addr);
+                memcpy(cache, pool + base, std::min(size_t(LINE), MEM_SIZE - base) * sizeof(uint32_t));
+                pc = addr - base;
             }
             uint32_t get() {
                 uint32_t ret = 0;
@@ -126,13 +311,383 @@ namespace RISC_V {
             }
             bool empty() {return pc >= (SIZE<<2);}
             void clear() {pc = (SIZE<<2);}
-            void display() {
+            bool peek(uint32_t& insCode) const { //本行中下一条指令，不前进；行已取完时返回 false
+                if (pc + 4 > (SIZE<<2)) return false;
+                insCode = 0;
+                for (int i = pc + 3; i >= signed(pc); --i) insCode = (insCode << 8) + cache[i];
+                return true;
+            }
+            void display() const {
                 std::cout << "Cache: ";
                 for (int i = 0; i < (SIZE<<2); ++i) std::cout << std::hex << cache[i] << ' ';
                 std::cout << '\n';
             }
 
         };
+
+        /*
+         * 循环缓冲 (Loop Stream Detector)：同一条向后分支连续两次跳转、且循环体不超过 SIZE 条指令时，
+         * 把循环体已译码的 Instruction 存下来。锁定后 IF 直接从缓冲取指（到分支处回到循环开头，
+         * 循环内的 JAL 直接跟随目标），不访问 ICache，ID 也不再调用 Decoder。取指离开循环范围即解锁。
+         */
+        template<size_t SIZE = 32>
+        class LoopBuffer {
+        private:
+            struct Entry {
+                uint32_t insCode;
+                Instruction ir;
+                bool valid;
+            };
+            Entry buf[SIZE];
+            uint32_t start, end; //循环 [start, end]，end 为向后分支
+            size_t iterations; //该分支连续跳转的次数
+            bool locked;
+
+            bool inside(uint32_t pc) const { return pc >= start && pc <= end; }
+
+            uint32_t next(uint32_t pc) const { //缓冲中 pc 之后取的指令
+                if (pc == end) return start;
+                const Entry& e = buf[(pc - start) >> 2];
+                if (e.valid && e.ir.ins == JAL && inside(pc + e.ir.imm)) return pc + e.ir.imm;
+                return pc + 4;
+            }
+
+        public:
+            bool enabled;
+            size_t detected, streamed, decoded, exits; //streamed: 从缓冲取指的条数, decoded: 省掉的译码次数
+
+            explicit LoopBuffer(bool _enabled = true) : start(1), end(0), iterations(0), locked(false), enabled(_enabled),
+                                                        detected(0), streamed(0), decoded(0), exits(0) {
+                for (size_t i = 0; i < SIZE; ++i) buf[i].valid = false;
+            }
+
+            bool taken(uint32_t pc, uint32_t target) { //EX 阶段分支跳转，返回是否刚锁定 (锁定后由 hole 补齐没译码过的指令)
+                if (!enabled || target > pc || pc - target >= SIZE * 4) return false;
+                if (pc != end || target != start) {
+                    start = target, end = pc, iterations = 0, locked = false;
+                    for (size_t i = 0; i < SIZE; ++i) buf[i].valid = false;
+                }
+                if (++iterations < 2 || locked) return false;
+                locked = true, detected++;
+                return true;
+            }
+
+            bool hole(uint32_t& pc) const { //循环体中还没有译码过的第一条 (这两次迭代都没走到的路径)
+                for (uint32_t i = 0; i <= (end - start) >> 2; ++i)
+                    if (!buf[i].valid) return pc = start + (i << 2), true;
+                return false;
+            }
+
+            void capture(uint32_t pc, uint32_t insCode, const Instruction& ir) { //ID 阶段译码后记录
+                if (!enabled || !inside(pc)) return;
+                buf[(pc - start) >> 2] = {insCode, ir, true};
+            }
+
+            bool fetch(uint32_t& pc, uint32_t& insCode) { //锁定时供给取指，pc 前进到下一条
+                if (!locked) return false;
+                if (!inside(pc)) {
+                    locked = false, exits++;
+                    return false;
+                }
+                insCode = buf[(pc - start) >> 2].insCode;
+                pc = next(pc);
+                streamed++;
+                return true;
+            }
+
+            bool followed(uint32_t pc, uint32_t follow) const { //取指是否已经跟随了 pc 处的跳转, follow 为其后取的指令
+                return enabled && inside(pc) && next(pc) != pc + 4 && follow == next(pc);
+            }
+
+            bool peek(uint32_t pc, uint32_t& insCode) const { //锁定时缓冲中 pc 处的指令，不前进
+                if (!locked || !inside(pc)) return false;
+                insCode = buf[(pc - start) >> 2].insCode;
+                return true;
+            }
+
+            bool decode(uint32_t pc, uint32_t insCode, Instruction& ir) { //命中则不必重新译码
+                if (!enabled || !inside(pc)) return false;
+                const Entry& e = buf[(pc - start) >> 2];
+                if (!e.valid || e.insCode != insCode) return false;
+                ir = e.ir, decoded++;
+                return true;
+            }
+
+            void display() {
+                std::cout << "* Loop Buffer *" << '\n';
+                std::cout << "Loops:" << detected << ", Exits:" << exits << ", Streamed:" << streamed << ", Decode Skipped:" << decoded << '\n';
+            }
+        };
+
+        /*
+         * 宏融合：IF 预译码发现可能的第一条时，若下一条也在同一取指块 (ICache 行或锁定的循环缓冲) 中且两者能融合，
+         * 就把两条一起取回放进同一个 IF_ID，ID 再把这一对合成一条内部操作，
+         * 第二条不再单独经过流水线，两者之间的数据冒险也就没有了。要求第二条写回的就是第一条的 rd
+         * （比较+分支除外），这样融合后仍只写一个寄存器。
+         *   LUI rd, hi + ADDI rd, rd, lo          -> LUI rd, hi+lo
+         *   AUIPC rd, hi + JALR rd, lo(rd)        -> JAL rd, hi+lo   (返回地址为 pc+8)
+         *   SLLI rd, rs, sh + ADD rd, rd, rs2     -> SHADD rd = (rs << sh) + rs2
+         *   SLT(U) rd, rs1, rs2 + BNE/BEQ rd, x0  -> CMPBR 写 rd 并按其结果跳转
+         */
+        class MacroFusion {
+        public:
+            enum Kind {LUI_ADDI, AUIPC_JALR, SLLI_ADD, CMP_BRANCH};
+
+            bool enabled;
+            size_t fused[4]; //提交的融合指令数
+
+            explicit MacroFusion(bool _enabled = true) : enabled(_enabled) { memset(fused, 0, sizeof(fused)); }
+
+            bool mayLead(uint32_t insCode) const { //取指时的预译码，只看 opcode、funct3、funct7 与 rd
+                uint32_t opcode = insCode & 127, funct3 = (insCode >> 12) & 7, funct7 = insCode >> 25;
+                if (!enabled || !((insCode >> 7) & 31)) return false;
+                return opcode == 0b0110111 || opcode == 0b0010111 || (opcode == 0b0010011 && funct3 == 1 && !funct7) ||
+                       (opcode == 0b0110011 && (funct3 == 2 || funct3 == 3) && !funct7);
+            }
+
+            bool pairs(uint32_t first, uint32_t second) const { //IF 预译码：相邻两条的编码能否融合，条件与 fuse 相同，不经过 Decoder
+                if (!mayLead(first)) return false;
+                uint32_t rd = (first >> 7) & 31, opcode = second & 127, funct3 = (second >> 12) & 7, funct7 = second >> 25;
+                uint32_t rd2 = (second >> 7) & 31, rs1 = (second >> 15) & 31, rs2 = (second >> 20) & 31;
+                switch (first & 127) {
+                    case 0b0110111: return opcode == 0b0010011 && funct3 == 0 && rs1 == rd && rd2 == rd; //LUI + ADDI
+                    case 0b0010111: return opcode == 0b1100111 && funct3 == 0 && rs1 == rd && rd2 == rd; //AUIPC + JALR
+                    case 0b0010011: return opcode == 0b0110011 && funct3 == 0 && !funct7 && rd2 == rd && (rs1 == rd) != (rs2 == rd); //SLLI + ADD
+                    default: return opcode == 0b1100011 && funct3 <= 1 && ((rs1 == rd && !rs2) || (!rs1 && rs2 == rd)); //SLT(U) + BEQ/BNE
+                }
+            }
+
+            bool leads(const Instruction& a) const { //a 能否作为融合对的第一条
+                return enabled && a.rd && (a.ins == LUI || a.ins == AUIPC || a.ins == SLLI || a.ins == SLT || a.ins == SLTU);
+            }
+
+            bool fuse(const Instruction& a, const Instruction& b, Instruction& ret) const { //a, b 相邻，成功时 ret 为融合结果
+                if (!leads(a)) return false;
+                if (a.ins == LUI && b.ins == ADDI && b.rs1 == a.rd && b.rd == a.rd) {
+                    ret = a, ret.imm = a.imm + b.imm;
+                }
+                else if (a.ins == AUIPC && b.ins == JALR && b.rs1 == a.rd && b.rd == a.rd) {
+                    ret = a, ret.ins = JAL, ret.opcode = 0b1101111, ret.imm = a.imm + b.imm;
+                }
+                else if (a.ins == SLLI && b.ins == ADD && b.rd == a.rd && (b.rs1 == a.rd) != (b.rs2 == a.rd)) {
+                    ret = a, ret.ins = SHADD, ret.rs2 = b.rs1 == a.rd ? b.rs2 : b.rs1;
+                }
+                else if ((a.ins == SLT || a.ins == SLTU) && (b.ins == BNE || b.ins == BEQ) &&
+                         ((b.rs1 == a.rd && !b.rs2) || (!b.rs1 && b.rs2 == a.rd))) {
+                    ret = a, ret.ins = CMPBR, ret.opcode = b.opcode;
+                    ret.imm = b.imm + 4; //相对第一条的地址
+                    ret.funct3 = (a.ins == SLTU) | (b.ins == BEQ) << 1; //bit0: 无符号比较, bit1: 结果为 0 时跳转
+                }
+                else return false;
+                ret.size = 8;
+                return true;
+            }
+
+            void retire(const Instruction& ir) {
+                if (ir.size != 8) return;
+                fused[ir.ins == LUI ? LUI_ADDI : ir.ins == JAL ? AUIPC_JALR : ir.ins == SHADD ? SLLI_ADD : CMP_BRANCH]++;
+            }
+
+            void display() {
+                std::cout << "* Macro Fusion *" << '\n';
+                std::cout << "LUI+ADDI:" << fused[LUI_ADDI] << ", AUIPC+JALR:" << fused[AUIPC_JALR]
+                          << ", SLLI+ADD:" << fused[SLLI_ADD] << ", Compare+Branch:" << fused[CMP_BRANCH] << '\n';
+            }
+        };
+
+        /*
+         * 向量单元 (RVV 子集，e32、LMUL=1)：向量指令都在 MEM 阶段按程序顺序执行，运算由 SIMD:: 的宿主机 SIMD 实现完成
+         * 计时按 lanes 条通道：每周期处理 lanes 个元素，归约再加 log2(lanes) 级加法树；
+         * 连续访存等 MEM_LATENCY 后每周期 lanes 个字，跨步访存每周期一个元素
+         * 向量指令进入 MEM 之前，CPU 按 latency 让整条流水线等待 (同阻塞访存)
+         */
+        class VectorUnit {
+        private:
+            size_t groups() const { return std::max<size_t>(1, (vl + lanes - 1) / lanes); }
+
+            static size_t log2(size_t x) {
+                size_t ret = 0;
+                while ((size_t(1) << ret) < x) ret++;
+                return ret;
+            }
+
+            static SIMD::Op op(InsType ins) {
+                switch (ins) {
+                    case VSUB: return SIMD::SUB;
+                    case VRSUB: return SIMD::RSUB;
+                    case VAND: case VREDAND: return SIMD::AND;
+                    case VOR: case VREDOR: return SIMD::OR;
+                    case VXOR: case VREDXOR: return SIMD::XOR;
+                    case VSLL: return SIMD::SLL;
+                    case VSRL: return SIMD::SRL;
+                    case VSRA: return SIMD::SRA;
+                    case VMIN: case VREDMIN: return SIMD::MIN;
+                    case VMINU: case VREDMINU: return SIMD::MINU;
+                    case VMAX: case VREDMAX: return SIMD::MAX;
+                    case VMAXU: case VREDMAXU: return SIMD::MAXU;
+                    case VMUL: return SIMD::MUL;
+                    default: return SIMD::ADD;
+                }
+            }
+
+        public:
+            size_t lanes, vl;
+            bool vill; //vtype 不受支持，vl 为 0
+            size_t instructions, elements, cycles; //cycles: 占用 MEM 的总周期
+
+            explicit VectorUnit(size_t _lanes = 4) : lanes(std::max<size_t>(1, std::min(_lanes, VLMAX))), vl(0), vill(true),
+                                                     instructions(0), elements(0), cycles(0) {}
+
+            size_t latency(const Instruction& ir) const { //按当前 vl 计算占用 MEM 的周期数
+                switch (ir.ins) {
+                    case VSETVLI: case VMVXS: case VMVSX: return 1;
+                    case VLE32: case VSE32: return MEM_LATENCY + groups() - 1;
+                    case VLSE32: case VSSE32: return MEM_LATENCY + std::max<size_t>(vl, 1) - 1;
+                    case VREDSUM: case VREDAND: case VREDOR: case VREDXOR:
+                    case VREDMIN: case VREDMINU: case VREDMAX: case VREDMAXU:
+                        return groups() + log2(std::min(vl, lanes));
+                    default: return groups();
+                }
+            }
+
+            //A, B 为 rs1, rs2 的值，返回写回 rd 的值
+            uint32_t execute(const Instruction& ir, uint32_t A, uint32_t B, BASIC::VectorRegisters& v, BASIC::Memory& mem) {
+                uint32_t ret = 0;
+                instructions++, cycles += latency(ir);
+                switch (ir.ins) {
+                    case VSETVLI: {
+                        vill = (ir.imm & ~0xc0u) != 0b010000; //vsew=e32, vlmul=1，忽略 vta/vma
+                        size_t avl = ir.rs1 ? A : ir.rd ? VLMAX : vl;
+                        vl = vill ? 0 : std::min(avl, VLMAX);
+                        return vl;
+                    }
+                    case VLE32:
+                        mem.readWords(A, v[ir.vd], vl);
+                        break;
+                    case VSE32:
+                        mem.writeWords(A, v[ir.vd], vl);
+                        break;
+                    case VLSE32:
+                        for (size_t i = 0; i < vl; ++i) v[ir.vd][i] = mem.read(uint32_t(A + i * B), 4);
+                        break;
+                    case VSSE32:
+                        for (size_t i = 0; i < vl; ++i) mem.write(uint32_t(A + i * B), v[ir.vd][i], 4);
+                        break;
+                    case VMVXS:
+                        ret = v[ir.vs2][0];
+                        break;
+                    case VMVSX:
+                        if (vl) v[ir.vd][0] = A;
+                        break;
+                    case VMV:
+                        if (ir.funct3 == OPIVV) std::copy(v[ir.vs1], v[ir.vs1] + vl, v[ir.vd]);
+                        else std::fill(v[ir.vd], v[ir.vd] + vl, ir.funct3 == OPIVX ? A : ir.imm);
+                        break;
+                    case VREDSUM: case VREDAND: case VREDOR: case VREDXOR:
+                    case VREDMIN: case VREDMINU: case VREDMAX: case VREDMAXU:
+                        if (vl) v[ir.vd][0] = SIMD::reduce(op(ir.ins), v[ir.vs2], vl, v[ir.vs1][0]);
+                        break;
+                    default:
+                        if (ir.funct3 == OPIVV || ir.funct3 == OPMVV) SIMD::binary(op(ir.ins), v[ir.vd], v[ir.vs2], v[ir.vs1], vl);
+                        else SIMD::binary(op(ir.ins), v[ir.vd], v[ir.vs2], ir.funct3 == OPIVI ? ir.imm : A, vl);
+                }
+                elements += vl;
+                return ret;
+            }
+
+            void display() {
+                std::cout << "* Vector Unit *" << '\n';
+                std::cout << "Lanes:" << lanes << ", Instructions:" << instructions << ", Elements:" << elements
+                          << ", Busy Cycles:" << cycles << ", Elements/Cycle:" << (cycles ? 1.0 * elements / cycles : 0) << '\n';
+            }
+        };
+
+        /*
+         * 指令预取：next-line、stream、branch-target 三种来源的请求进入预取队列，
+         * 每周期向内存发出一个，LATENCY 周期后到达预取缓冲 (ENTRIES 行, FIFO 替换)。
+         * ICache 缺失时先查预取缓冲，命中则不必等待整个访存延迟。
+         */
+        template<size_t ENTRIES = 8, size_t QUEUE = 8, uint32_t LINE = 64>
+        class Prefetcher {
+        private:
+            struct Line {
+                uint32_t addr;
+                size_t ready; //到达的周期
+                bool valid, used;
+            };
+            Line buf[ENTRIES];
+            uint32_t queue[QUEUE];
+            size_t victim, qhead, qcnt, streamLen;
+            uint32_t lastLine;
+
+            Line* find(uint32_t addr) {
+                for (size_t i = 0; i < ENTRIES; ++i)
+                    if (buf[i].valid && buf[i].addr == addr) return buf + i;
+                return nullptr;
+            }
+
+            void request(uint32_t addr) {
+                if (!degree || addr + LINE > MEM_SIZE || find(addr)) return;
+                for (size_t i = 0; i < qcnt; ++i) if (queue[(qhead + i) % QUEUE] == addr) return;
+                if (qcnt == QUEUE) {
+                    dropped++;
+                    return;
+                }
+                queue[(qhead + qcnt++) % QUEUE] = addr;
+            }
+
+        public:
+            size_t degree; //0 关闭预取
+            size_t issued, useful, wasted, dropped; //useful: 至少被用到一次的预取行, wasted: 未用就被替换
+            size_t hits, late, misses; //ICache 缺失时: 预取行已到达 / 还在路上 / 不在预取缓冲
+
+            explicit Prefetcher(size_t _degree = 2) : victim(0), qhead(0), qcnt(0), streamLen(0), lastLine(-LINE),
+                                                      degree(_degree), issued(0), useful(0), wasted(0), dropped(0), hits(0), late(0), misses(0) {
+                for (size_t i = 0; i < ENTRIES; ++i) buf[i].valid = false;
+            }
+
+            void tick(size_t now) { //发出一个预取请求
+                if (!qcnt) return;
+                Line& l = buf[victim];
+                if (l.valid && !l.used) wasted++;
+                l = {queue[qhead], now + MEM_LATENCY - 1, true, false};
+                victim = (victim + 1) % ENTRIES;
+                qhead = (qhead + 1) % QUEUE, qcnt--;
+                issued++;
+            }
+
+            size_t demand(uint32_t addr, size_t now) { //ICache 缺失，返回取指还需等待的周期数
+                size_t wait = MEM_LATENCY - 1;
+                Line* l = find(addr);
+                if (l) {
+                    wait = l->ready > now ? l->ready - now : 0;
+                    if (wait) late++;
+                    else hits++;
+                    if (!l->used) l->used = true, useful++;
+                }
+                else misses++;
+
+                //next-line：每次缺失预取下一行；本行紧接上一次缺失的行 (连续两次顺序缺失) 时视为 stream，改为向前预取 degree 行
+                streamLen = (addr == lastLine + LINE) ? streamLen + 1 : 0;
+                lastLine = addr;
+                size_t ahead = streamLen ? degree : 1;
+                for (size_t i = 1; i <= ahead; ++i) request(addr + i * LINE);
+                return wait;
+            }
+
+            void branchTarget(uint32_t target) { //ID 阶段已知跳转目标
+                request(target & ~(LINE - 1));
+            }
+
+            void display() {
+                std::cout << "* Prefetcher *" << '\n';
+                std::cout << "Degree:" << degree << ", Issued:" << issued << ", Useful:" << useful << ", Wasted:" << wasted
+                          << ", Dropped:" << dropped << '\n';
+                std::cout << "ICache Miss:" << hits + late + misses << ", Covered:" << hits << ", Late:" << late << ", Uncovered:" << misses << '\n';
+                std::cout << "Accuracy:" << (issued ? 1.0 * useful / issued : 0)
+                          << ", Coverage:" << (hits + late + misses ? 1.0 * (hits + late) / (hits + late + misses) : 0) << '\n';
+            }
+        };
     }
 }
 
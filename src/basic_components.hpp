@@ -6,6 +6,8 @@
 #define RISC_V_SIMULATOR_BASIC_COMPONENTS_HPP
 
 #include "include.hpp"
+#include "elf_loader.hpp"
+#include "simd.hpp"
 
 namespace RISC_V {
     namespace BASIC {
@@ -72,20 +74,42 @@ namespace RISC_V {
             }
         };
 
+        class VectorRegisters { //32 个 VLEN 位的向量寄存器，按 32 位元素存放
+        private:
+            uint32_t vregs[REG_N][VLMAX]; //不用 alignas：SIMD:: 访问寄存器一律用非对齐的 loadu / storeu，对齐没有好处
+        public:
+            VectorRegisters() {
+                memset(vregs, 0, sizeof(vregs));
+            }
+
+            void display() const {
+                for (size_t i = 0; i < REG_N; ++i) {
+                    std::cout << std::dec << "v[" << i << "]:";
+                    for (size_t j = 0; j < VLMAX; ++j) std::cout << ' ' << vregs[i][j];
+                    std::cout << '\n';
+                }
+            }
+
+            uint32_t* operator [] (size_t pos) { return vregs[pos]; }
+
+            const uint32_t* operator [] (size_t pos) const { return vregs[pos]; }
+        };
+
         struct StageRegister {
             Instruction IR;
-            uint32_t insCode, out, pc, A, B;
+            uint32_t insCode, out, pc, A, B, C, D, uid; //C, D: ECALL 的 a1, a2; uid: 取指时分配的编号，0 表示气泡
+            uint32_t fuseCode; //IF 一起取回、与本条融合的下一条 (pc+4)，0 表示没有
 
-            StageRegister() : IR(), insCode(0), out(0), pc(0), A(0), B(0) {}
+            StageRegister() : IR(), insCode(0), out(0), pc(0), A(0), B(0), C(0), D(0), uid(0), fuseCode(0) {}
 
             bool operator == (const StageRegister& obj) const {
                 return IR == obj.IR && insCode == obj.insCode && out == obj.out && pc == obj.pc
-                && A == obj.A && B == obj.B;
+                && A == obj.A && B == obj.B && C == obj.C && D == obj.D && uid == obj.uid && fuseCode == obj.fuseCode;
             }
 
             void clear() {
                 IR.init();
-                insCode = out = pc = A = B = 0;
+                insCode = out = pc = A = B = C = D = uid = fuseCode = 0;
             }
         };
 
@@ -128,30 +152,95 @@ namespace RISC_V {
 
         class Memory {
         private:
+            static const size_t PAGE = 4096, PAGES = (MEM_SIZE + PAGE - 1) / PAGE; //脏页位图的粒度 (字节)
             uint32_t memPool[MEM_SIZE];
+            bool dirty[PAGES]; //上次清零以来写过的页，其余的页一定全为 0
             size_t siz;
+
+            struct Segment {
+                uint32_t addr;
+                std::vector<uint32_t> data;
+            };
+            std::vector<Segment> image; //载入后的初始内容，restore 时写回，不必重新解析
+
+            void touch(size_t pos, size_t bytes) { //[pos, pos + bytes) 所在的页记为脏
+                for (size_t p = pos / PAGE; p <= (pos + bytes - 1) / PAGE; ++p) dirty[p] = true;
+            }
+
+            void clear() { //只清零写过的页，MEM_SIZE 的内存池只在构造时整个清零一次
+                for (size_t p = 0; p < PAGES; ++p)
+                    if (dirty[p]) memset(memPool + p * PAGE, 0, std::min(size_t(PAGE), MEM_SIZE - p * PAGE) * sizeof(uint32_t)), dirty[p] = false;
+            }
+
+            void parse(const std::string& program, std::vector<std::pair<uint32_t, uint32_t>>& ranges) { //写入内存池，ranges 为写过的 (addr, 字节数)
+                if (ELFLoader::isELF(program)) {
+                    ELFLoader loader(program);
+                    loader.load(memPool, MEM_SIZE, symbols);
+                    entry = loader.entry, siz = loader.end, isELF = true;
+                    ranges = loader.segments;
+                }
+                else {
+                    std::istringstream fin(program);
+                    std::string buffer;
+                    while (fin >> buffer) {
+                        std::stringstream trans;
+                        if (buffer[0] == '@') {
+                            trans << std::hex << buffer.substr(1);
+                            trans >> siz;
+                            ranges.push_back(std::make_pair(siz, 0));
+                        } else {
+                            if (siz >= MEM_SIZE) throw std::runtime_error("hex: address exceeds simulator memory");
+                            if (ranges.empty()) ranges.push_back(std::make_pair(siz, 0));
+                            trans << std::hex << buffer;
+                            trans >> memPool[siz++];
+                            ranges.back().second++;
+                            //std::cout << memPool[siz-1] << '\n';
+                        }
+                    }
+                }
+            }
+
         public:
-            Memory() : siz(0) {
-                memset(memPool, 0, sizeof(memPool));
-                std::string buffer;
-                while (std::cin >> buffer) {
-                    std::stringstream trans;
-                    if (buffer[0] == '@') {
-                        trans << std::hex << buffer.substr(1);
-                        trans >> siz;
-                    } else {
-                        trans << std::hex << buffer;
-                        trans >> memPool[siz++];
-                        //std::cout << memPool[siz-1] << '\n';
+            uint32_t entry; //程序入口
+            bool isELF;
+            SymbolTable symbols;
+
+            Memory() : memPool(), dirty(), siz(0), entry(0), isELF(false) { //从 stdin 读入程序
+                load(std::string((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>()));
+            }
+
+            explicit Memory(const std::string& program) : memPool(), dirty(), siz(0), entry(0), isELF(false) { load(program); }
+
+            void load(const std::string& program) { //ELF 或 @addr 格式的 hex 文本
+                clear();
+                siz = entry = 0, isELF = false;
+                symbols.clear(), image.clear();
+                std::vector<std::pair<uint32_t, uint32_t>> ranges;
+                try {
+                    parse(program, ranges);
+                } catch (...) { //不知道已经写了哪些页，下次全部清零
+                    std::fill(dirty, dirty + PAGES, true);
+                    throw;
+                }
+                for (auto& r : ranges)
+                    if (r.second) {
+                        image.push_back({r.first, std::vector<uint32_t>(memPool + r.first, memPool + r.first + r.second)});
+                        touch(r.first, r.second);
                     }
+            }
+
+            void restore() { //回到刚载入时的状态：清零写过的页，再写回载入的内容
+                clear();
+                for (const Segment& seg : image) {
+                    std::copy(seg.data.begin(), seg.data.end(), memPool + seg.addr);
+                    touch(seg.addr, seg.data.size());
                 }
-#ifdef DEBUG
-                MINE("build finish. size: " << siz)
-#endif
             }
 
             uint32_t * getPool() {return memPool;}
 
+            const uint32_t * getPool() const {return memPool;}
+
             size_t size() const { return siz; }
 
             uint32_t read(size_t pos, size_t bytes = 1) const {
@@ -169,14 +258,29 @@ namespace RISC_V {
             }
 
             void write(size_t pos, uint32_t val, size_t bytes = 1) {
+                dirty[pos / PAGE] = dirty[(pos + bytes - 1) / PAGE] = true;
                 for (int i = pos; i < pos + bytes; ++i)
                     memPool[i] = slice(val, 0, 7), val >>= 8;
             }
+
+            //连续 n 个字，向量 load/store 用；超出内存的部分不访问
+            void readWords(size_t pos, uint32_t* words, size_t n) const {
+                if (pos >= MEM_SIZE) return;
+                SIMD::packBytes(memPool + pos, words, std::min(n, (MEM_SIZE - pos) / 4));
+            }
+
+            void writeWords(size_t pos, const uint32_t* words, size_t n) {
+                if (pos >= MEM_SIZE) return;
+                n = std::min(n, (MEM_SIZE - pos) / 4);
+                if (n) touch(pos, n * 4);
+                SIMD::unpackBytes(words, memPool + pos, n);
+            }
         };
 
         class SignalBus {
         public:
-            bool isJump, isBranch, branchHit, predictHit, memoryAccess, delayFlag;
+            bool isJump, isBranch, branchHit, predictHit, memoryAccess, vectorAccess, delayFlag;
+            bool branchDecoded, decodeHit; //ID 本周期译出条件分支; ID 比较器的结果
             uint32_t tarpc;
             void jumpInfoClear() {
                 isJump = isBranch = branchHit = predictHit = 0;
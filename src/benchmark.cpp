@@ -0,0 +1,259 @@
+// 模拟器自身的性能基准：元件级 microbenchmark + 每个 testcase / 合成负载的端到端吞吐
+// 输出为 CSV (name,metric,value)，并与 baseline 比较，超过阈值即视为性能回退
+// baseline 可能来自另一台机器：先用一段固定的整数依赖链标定宿主机速度，按两次标定之比换算 baseline 后再比较
+
+#include "cpu_core.hpp"
+#include <chrono>
+#include <fstream>
+#include <vector>
+#include <memory>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+namespace RISC_V {
+    namespace BENCH {
+        const std::string runList[] = {"array_test1", "array_test2", "basicopt1", "bulgarian", "expr", "gcd", "hanoi",
+                                       "lvalue2", "magic", "manyarguments", "multiarray", "naive", "pi", "qsort",
+                                       "queens", "statement_test", "superloop", "tak"};
+        const std::string workloadList[] = {"mixed", "chain", "branchy", "bigloop", "kernel"}; //performance/workloads/ 中 genWorkload.py 生成的负载
+        const std::string CALIBRATION = "host::calibration";
+
+        const size_t MICRO_OPS = 1 << 20, MICRO_REPEAT = 5, RUN_REPEAT = 3, BASELINE_RUNS = 3;
+
+        volatile uint32_t sink; //防止被优化掉
+
+        struct Result {
+            std::string name, metric;
+            double value;
+        };
+
+        static uint64_t hostCycles() {
+#ifdef BENCH_HAS_TSC
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        static double nowNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static bool lowerIsBetter(const std::string& metric) {
+            return metric != "guest_ips";
+        }
+
+        template<class Func>
+        static double measure(Func func) { //ns per op, best of MICRO_REPEAT
+            double best = 1e30;
+            for (size_t r = 0; r < MICRO_REPEAT; ++r) {
+                double st = nowNs();
+                func();
+                best = std::min(best, (nowNs() - st) / MICRO_OPS);
+            }
+            return best;
+        }
+
+        static double calibrate() { //乘加依赖链，只随宿主机主频与整数流水线变化
+            return measure([&]() {
+                uint32_t x = 1;
+                for (size_t i = 0; i < MICRO_OPS; ++i) x = x * 2654435761u + (x >> 13);
+                sink = x;
+            });
+        }
+
+        static void micro(std::vector<Result>& res) {
+            uint32_t codes[] = {0x00020137, 0x00c000ef, 0xff010113, 0x00112623, 0x00a12423, 0x00812783,
+                                0x00f70733, 0x40e787b3, 0x00279793, 0xfee7cce3, 0x0007a703, 0x00008067};
+            const size_t CODE_N = sizeof(codes) / sizeof(codes[0]);
+            Decoder id;
+            Instruction ins;
+            res.push_back({"Decoder::decode", "ns_per_op", measure([&]() {
+                for (size_t i = 0; i < MICRO_OPS; ++i) {
+                    id.decode(codes[i % CODE_N], ins);
+                    sink = ins.ins;
+                }
+            })});
+
+            std::unique_ptr<BASIC::Memory> mem(new BASIC::Memory(std::string()));
+            const size_t MASK = (1 << 16) - 1;
+            res.push_back({"Memory::write", "ns_per_op", measure([&]() {
+                for (size_t i = 0; i < MICRO_OPS; ++i) mem->write(((i * 2654435761u) & MASK) << 2, i, 4);
+            })});
+            res.push_back({"Memory::read", "ns_per_op", measure([&]() {
+                uint32_t acc = 0;
+                for (size_t i = 0; i < MICRO_OPS; ++i) acc += mem->read(((i * 2654435761u) & MASK) << 2, 4);
+                sink = acc;
+            })});
+
+            BASIC::ALU alu;
+            const char ops[] = {'+', '-', '<', '>', '&', '|', '^'};
+            res.push_back({"ALU::input", "ns_per_op", measure([&]() {
+                uint32_t acc = 0;
+                for (size_t i = 0; i < MICRO_OPS; ++i) {
+                    alu.input(i * 2654435761u, i & 31, ops[i % 7], i & 1);
+                    acc += alu.ALUOut + alu.neg;
+                }
+                sink = acc;
+            })});
+
+            std::unique_ptr<ADVANCED::BranchPredictor<12, 6>> predictor(new ADVANCED::BranchPredictor<12, 6>(ADVANCED::TWOLEVEL));
+            res.push_back({"BranchPredictor::predict+update", "ns_per_op", measure([&]() {
+                uint32_t acc = 0;
+                for (size_t i = 0; i < MICRO_OPS; ++i) {
+                    acc += predictor->predict((i * 40503u) & 0xffc);
+                    predictor->update(i % 3 != 0);
+                }
+                sink = acc;
+            })});
+        }
+
+        template<size_t N>
+        static void endToEnd(const std::string& dir, const std::string (&names)[N], std::vector<Result>& res) {
+            std::istringstream empty;
+            std::ostringstream discard;
+            std::unique_ptr<CPU> cpu; //所有程序共用一个 CPU，只换程序
+            for (const std::string& name : names) {
+                std::ifstream fin(dir + name + ".data");
+                if (!fin) {
+                    std::cerr << "skip " << name << ": no " << dir << name << ".data\n";
+                    continue;
+                }
+                std::string program((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+                if (cpu) cpu->load(program);
+                else {
+                    cpu.reset(new CPU(program, ADVANCED::TWOLEVEL, ADVANCED::FORWARDING));
+                    cpu->setIO(empty, discard);
+                }
+                double best = 1e30;
+                uint64_t bestCycles = UINT64_MAX;
+                for (size_t r = 0; r < RUN_REPEAT; ++r) { //best of RUN_REPEAT，每次 reset 回到刚载入的状态
+                    srand(0);
+                    if (r) cpu->reset();
+                    double st = nowNs();
+                    uint64_t hst = hostCycles();
+                    cpu->run();
+                    uint64_t hed = hostCycles();
+                    double ed = nowNs();
+                    discard.str("");
+                    best = std::min(best, ed - st), bestCycles = std::min(bestCycles, hed - hst);
+                }
+                res.push_back({name, "guest_ips", cpu->instructions() / (best * 1e-9)});
+                res.push_back({name, "host_cycles_per_sim_cycle", 1.0 * bestCycles / cpu->cycles()});
+            }
+        }
+
+        static std::vector<Result> measureAll(const std::string& testDir, const std::string& workloadDir) {
+            std::vector<Result> res;
+            double calibration = calibrate(); //测量前后各标定一次取较快的，减少宿主机频率变化的影响
+            res.push_back({CALIBRATION, "ns_per_op", calibration});
+            micro(res);
+            endToEnd(testDir, runList, res);
+            endToEnd(workloadDir, workloadList, res);
+            res[0].value = std::min(calibration, calibrate());
+            return res;
+        }
+
+        static std::vector<Result> median(const std::vector<std::vector<Result>>& runs) { //逐项取中位数，baseline 不被某一次偶然的快慢带偏
+            std::vector<Result> ret = runs[0];
+            for (size_t i = 0; i < ret.size(); ++i) {
+                std::vector<double> values;
+                for (const std::vector<Result>& run : runs) values.push_back(run[i].value);
+                std::sort(values.begin(), values.end());
+                ret[i].value = values[values.size() / 2];
+            }
+            return ret;
+        }
+
+        static std::map<std::pair<std::string, std::string>, double> loadBaseline(const std::string& path) {
+            std::map<std::pair<std::string, std::string>, double> ret;
+            std::ifstream fin(path);
+            std::string line;
+            while (std::getline(fin, line)) {
+                size_t p1 = line.find(','), p2 = line.rfind(',');
+                if (p1 == std::string::npos || p1 == p2 || line[0] == '#') continue;
+                std::stringstream trans(line.substr(p2 + 1));
+                double val;
+                if (trans >> val) ret[{line.substr(0, p1), line.substr(p1 + 1, p2 - p1 - 1)}] = val;
+            }
+            return ret;
+        }
+
+        static void writeCSV(std::ostream& os, const std::vector<Result>& res) {
+            os << "name,metric,value\n";
+            for (const Result& r : res) os << r.name << ',' << r.metric << ',' << std::setprecision(6) << r.value << '\n';
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    using namespace RISC_V::BENCH;
+
+    std::string testDir = "testcases/", workloadDir = "performance/workloads/", baselinePath = "performance/bench_baseline.csv", outPath;
+    double threshold = 10; //%
+    bool update = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--update-baseline") update = true;
+        else if (i + 1 < argc && (arg == "-t" || arg == "--testcases")) testDir = argv[++i];
+        else if (i + 1 < argc && (arg == "-w" || arg == "--workloads")) workloadDir = argv[++i];
+        else if (i + 1 < argc && (arg == "-b" || arg == "--baseline")) baselinePath = argv[++i];
+        else if (i + 1 < argc && (arg == "-o" || arg == "--output")) outPath = argv[++i];
+        else if (i + 1 < argc && (arg == "-r" || arg == "--threshold")) threshold = atof(argv[++i]);
+        else {
+            std::cerr << "usage: " << argv[0] << " [-t testcases/] [-w workloads/] [-b baseline.csv] [-o out.csv] [-r threshold%] [--update-baseline]\n";
+            return 2;
+        }
+    }
+    if (!testDir.empty() && testDir.back() != '/') testDir += '/';
+    if (!workloadDir.empty() && workloadDir.back() != '/') workloadDir += '/';
+
+    std::vector<Result> res = measureAll(testDir, workloadDir);
+    if (update) { //baseline 取 BASELINE_RUNS 次完整测量的中位数
+        std::vector<std::vector<Result>> runs = {res};
+        while (runs.size() < BASELINE_RUNS) runs.push_back(measureAll(testDir, workloadDir));
+        res = median(runs);
+    }
+
+    writeCSV(std::cout, res);
+    if (!outPath.empty()) {
+        std::ofstream fout(outPath);
+        writeCSV(fout, res);
+    }
+    if (update) {
+        std::ofstream fout(baselinePath);
+        writeCSV(fout, res);
+        std::cerr << "baseline written to " << baselinePath << '\n';
+        return 0;
+    }
+
+    auto baseline = loadBaseline(baselinePath);
+    if (baseline.empty()) {
+        std::cerr << "no baseline at " << baselinePath << ", skip comparison\n";
+        return 0;
+    }
+    double scale = 1; //本机相对 baseline 所在机器慢多少倍
+    auto cal = baseline.find({CALIBRATION, "ns_per_op"});
+    if (cal != baseline.end() && cal->second > 0) scale = res[0].value / cal->second;
+    else std::cerr << "baseline has no " << CALIBRATION << " row, compare raw values\n";
+    std::cerr << "host calibration: " << scale << "x baseline time\n";
+    int regressions = 0;
+    for (const Result& r : res) {
+        auto it = baseline.find({r.name, r.metric});
+        if (r.name == CALIBRATION || it == baseline.end() || it->second <= 0) continue;
+        double expected = lowerIsBetter(r.metric) ? it->second * scale : it->second / scale;
+        double change = (r.value - expected) / expected * 100; //%
+        if (!lowerIsBetter(r.metric)) change = -change;
+        if (change > threshold) {
+            std::cerr << "REGRESSION " << r.name << ' ' << r.metric << ": " << it->second << " (" << expected << " on this host) -> "
+                      << r.value << " (" << int(change) << "% worse)\n";
+            regressions++;
+        }
+    }
+    std::cerr << regressions << " regression(s), threshold " << threshold << "%\n";
+    return regressions ? 1 : 0;
+}
@@ -8,47 +8,132 @@
 #include "decoder.hpp"
 #include "basic_components.hpp"
 #include "advanced_components.hpp"
+#include "pipeline_trace.hpp"
+#include "syscall.hpp"
+#include "instrument.hpp"
 
 namespace RISC_V {
 
-    class CPU {
+    enum StopType {STOP_HALT, STOP_CYCLE, STOP_PC}; //runUntil 的停止条件
+
+    /*
+     * 可嵌入使用：程序可以来自 stdin，也可以来自内存中的映像 (ELF 或 hex 文本)
+     * step / runUntil 逐步推进，reset 回到刚载入的状态，load 换一个程序，都不重新分配 CPU
+     * Instrument 为插桩策略 (见 instrument.hpp)，默认的 Null 不产生任何额外开销
+     */
+    template<class Instrument = INSTRUMENT::Null>
+    class CPUCore {
     public:
-        explicit CPU(ADVANCED::PredictorType _ptype, ADVANCED::HazardHandleType _htype):
-        pc(0), regs(), mem(), htype(_htype), predictor(_ptype), dataHazard(0) {}
+        explicit CPUCore(ADVANCED::PredictorType _ptype, ADVANCED::HazardHandleType _htype,
+                         ADVANCED::MemoryModelType _mtype = ADVANCED::NONBLOCKING, size_t _prefetchDegree = 2, bool _loopBuffer = true,
+                         bool _fusion = true, size_t _lanes = 4, bool _earlyBranch = false):
+        pc(0), regs(), mem(), predictor(_ptype), comparator(_earlyBranch), htype(_htype), mtype(_mtype), prefetcher(_prefetchDegree),
+        loopBuffer(_loopBuffer), fusion(_fusion), vector(_lanes) {
+            reset();
+            inst.setSymbols(&mem.symbols);
+        }
+
+        CPUCore(const std::string& program, ADVANCED::PredictorType _ptype, ADVANCED::HazardHandleType _htype,
+                ADVANCED::MemoryModelType _mtype = ADVANCED::NONBLOCKING, size_t _prefetchDegree = 2, bool _loopBuffer = true,
+                bool _fusion = true, size_t _lanes = 4, bool _earlyBranch = false):
+        pc(0), regs(), mem(program), predictor(_ptype), comparator(_earlyBranch), htype(_htype), mtype(_mtype), prefetcher(_prefetchDegree),
+        loopBuffer(_loopBuffer), fusion(_fusion), vector(_lanes) {
+            reset();
+            inst.setSymbols(&mem.symbols);
+        }
+
+        const SymbolTable& symbols() const { return mem.symbols; }
+
+        Instrument& instrument() { return inst; }
+
+        void attachTracer(TRACE::PipelineTracer* tracer) { inst.setTracer(tracer); } //只有带 KonataTrace 的 CPUCore 会记录; reset / load 时解除
+
+        void setIO(std::istream& in, std::ostream& out) { sys.setIO(&in, &out); } //ECALL 的标准输入输出, run 的返回值也输出到 out
+
+        void load(const std::string& program) { //换一个程序，失败时抛出 std::runtime_error
+            mem.load(program);
+            reset();
+        }
+
+        void reset() { //内存恢复为载入时的内容，寄存器、流水线与各元件的状态、统计全部清空（插桩策略的不清空）
+            inst.setTracer(nullptr); //周期与 uid 都从 0 重新开始，tracer 只记录一次运行，再跑一遍要重新 attach 一个新的
+            mem.restore();
+            regs = BASIC::Registers();
+            vregs = BASIC::VectorRegisters();
+            clock = BASIC::Clock();
+            bus = BASIC::SignalBus();
+            ID.clear(), EX.clear(), MEM.clear(), WB.clear();
+            IF_ID.clear(), ID_EX.clear(), EX_MEM.clear(), MEM_WB.clear();
+            predictor.reset();
+            comparator = ADVANCED::BranchComparator(comparator.enabled);
+            bypass.clear();
+            cache.clear();
+            prefetcher = ADVANCED::Prefetcher<8, 8, ADVANCED::ICache<16>::LINE>(prefetcher.degree);
+            refillLine = NO_REFILL, refillReady = 0;
+            loopBuffer = ADVANCED::LoopBuffer<32>(loopBuffer.enabled);
+            fusion = ADVANCED::MacroFusion(fusion.enabled);
+            vector = ADVANCED::VectorUnit(vector.lanes);
+            storeBuffer = ADVANCED::StoreBuffer<8>();
+            loadQueue = ADVANCED::LoadQueue<4>();
+            memBlocked = false;
+            sys.reset();
+            sys.setBreak(mem.size());
+            dataHazard = retired = 0, fetched = 0, retiredPC = retiredEnd = 0;
+            pc = mem.entry;
+            if (mem.isELF) regs.write(STACK_POINTER, MEM_SIZE & ~15u); //ELF 没有设置 sp 的启动代码时也能运行
+        }
+
+        bool halted() const { return EX.IR.ins == HALT || sys.exited; }
+
+        size_t step(size_t n = 1) { //推进 n 个周期，返回实际推进的周期数（停机后不再推进）
+            size_t cnt = 0;
+            for (; cnt < n && !halted(); ++cnt) cycle();
+            if (halted()) sys.flush();
+            return cnt;
+        }
+
+        StopType runUntil(StopType type, size_t value = 0) { //STOP_CYCLE: 周期数到 value; STOP_PC: 地址为 value 的指令提交 (融合对中任一条都算，两条同时提交); 先停机则返回 STOP_HALT
+            while (!halted()) {
+                if (type == STOP_CYCLE && clock.tick >= value) return STOP_CYCLE;
+                size_t last = retired;
+                cycle();
+                if (type == STOP_PC && retired != last && value >= retiredPC && value < retiredEnd) return STOP_PC;
+            }
+            sys.flush();
+            return STOP_HALT;
+        }
 
         void run() { //WB before ID
-            while (EX.IR.ins != HALT) {
-#ifdef DEBUG
-                        MINE("tick: " << clock.tick)
-#endif
-
-                        passMessage();
-                        int order[5] = {0, 1, 2, 3, 4};
-                        std::random_shuffle(order, order+5); //simulate parallel
-#ifdef DEBUG
-                        for (int i = 0; i < 5; ++i) std::cout << order[i] << ' '; std::cout << '\n';
-#endif
-                        for (int i = 0; i < 5; ++i) (this->*stageFunc[order[i]])();
-                        clock.clockIn();
-                        manage();
-
-#ifdef DEBUG
-                        std::cout << "IF:" << clock.stall[0] << " ID:" << clock.stall[1] << " EX:" << clock.stall[2] << " MEM:" << clock.stall[3] << " WB:" << clock.stall[4] << '\n';
-                        cache.display();
-                        bypass.display();
-                        regs.display();
-#endif
-                    }
-                    std::cout << std::dec << (regs.read(FUNCTION_RETURN) & 255u) << '\n';
-#ifdef LOCAL
-                    /*std::cout << "* Performance *" << '\n' << "Total Tick: " << clock.tick << '\n';
-                                        std::cout << "Data Hazard: " << dataHazard << '\n';
-                                        predictor.display(); */
+            runUntil(STOP_HALT);
+            if (!sys.exited) sys.output() << std::dec << (regs.read(FUNCTION_RETURN) & 255u) << '\n';
+        }
 
-                    //std::cout << 1.0*predictor.success/(predictor.success+predictor.wrong);
-                    //std::cout << clock.tick;
-#endif
-                }
+            void display() { //性能统计，main 中 --stats 开启
+                std::cout << "* Performance *" << '\n' << "Total Tick: " << clock.tick << ", Instructions: " << retired
+                          << ", CPI: " << (retired ? 1.0 * clock.tick / retired : 0) << '\n';
+                std::cout << "Data Hazard: " << dataHazard << '\n';
+                predictor.display();
+                comparator.display();
+                if (mtype == ADVANCED::NONBLOCKING) storeBuffer.display(), loadQueue.display();
+                prefetcher.display();
+                if (loopBuffer.enabled) loopBuffer.display();
+                if (fusion.enabled) fusion.display();
+                if (vector.instructions) vector.display();
+                inst.display();
+            }
+
+            //状态查看
+            uint32_t readReg(size_t pos) const { return regs.read(pos); }
+            uint32_t readMem(size_t addr, size_t bytes = 4) const { return mem.read(addr, bytes); }
+            const BASIC::Registers& registers() const { return regs; }
+            const BASIC::VectorRegisters& vectorRegisters() const { return vregs; }
+            const BASIC::Memory& memory() const { return mem; }
+            uint32_t fetchPC() const { return pc; } //IF 下一次取指的地址
+            uint32_t lastRetiredPC() const { return retiredPC; } //融合指令为其中第一条的地址
+            uint32_t lastRetiredEnd() const { return retiredEnd; } //最近提交的指令之后的地址，融合指令覆盖 [lastRetiredPC, lastRetiredEnd) 两条
+            size_t cycles() const { return clock.tick; } //模拟周期数
+            size_t instructions() const { return retired; } //WB 阶段提交的指令数，融合的一条按两条计
+            int exitCode() const { return sys.exited ? int(sys.exitCode & 255u) : 0; } //exit 系统调用的返回码
 
         private:
             //BASIC:: CPU 基础元件
@@ -58,6 +143,7 @@ namespace RISC_V {
             Decoder id; //译码中心
 
             BASIC::Registers regs; //CPU内置的通用寄存器组
+            BASIC::VectorRegisters vregs; //向量寄存器组 v0-v31
             BASIC::Memory mem; //内存
             BASIC::Clock clock; //调度时钟
             BASIC::ALU alu; //运算中心
@@ -66,11 +152,28 @@ namespace RISC_V {
             BASIC::StageRegister IF_ID, ID_EX, EX_MEM, MEM_WB; //衔接指令寄存器, INPUT_OUTPUT
 
             ADVANCED::BranchPredictor<12, 6> predictor; //分支预测器
+            ADVANCED::BranchComparator comparator; //enabled 时条件分支在 ID 确定
             ADVANCED::Bypass bypass; //旁路，用于data forwarding
             ADVANCED::HazardHandleType htype;
+            ADVANCED::MemoryModelType mtype; //BLOCKING: 每次访存整条流水线停 3 周期
             ADVANCED::ICache<16> cache;
+            ADVANCED::Prefetcher<8, 8, ADVANCED::ICache<16>::LINE> prefetcher; //指令预取
+            static const uint32_t NO_REFILL = -1;
+            uint32_t refillLine; //正在等待的 ICache 行
+            size_t refillReady;
+            ADVANCED::LoopBuffer<32> loopBuffer; //循环缓冲，锁定时 IF、ID 不访问 ICache 与 Decoder
+            ADVANCED::MacroFusion fusion; //宏融合，IF 把能融合的相邻两条一起取回，ID 合成一条
+            ADVANCED::VectorUnit vector; //向量单元，向量指令在 MEM 阶段执行
+            ADVANCED::StoreBuffer<8> storeBuffer; //NONBLOCKING 使用
+            ADVANCED::LoadQueue<4> loadQueue;
+            bool memBlocked; //当前 MEM 中的访存是否已按阻塞方式等待过
+            SyscallHandler sys; //ECALL 系统调用
+
+            size_t dataHazard, retired;
+            uint32_t fetched; //uid 分配
+            uint32_t retiredPC, retiredEnd; //最近一条提交的指令占的地址范围 [retiredPC, retiredEnd)
 
-            size_t dataHazard;
+            Instrument inst; //插桩
 
             void instructionFetch();
             void instructionDecode();
@@ -78,7 +181,19 @@ namespace RISC_V {
             void memoryAccess();
             void writeBack();
 
-            void (CPU::*stageFunc[5])() = {&CPU::instructionFetch, &CPU::instructionDecode, &CPU::execute, &CPU::memoryAccess, &CPU::writeBack};
+            void (CPUCore::*stageFunc[5])() = {&CPUCore::instructionFetch, &CPUCore::instructionDecode, &CPUCore::execute,
+                                               &CPUCore::memoryAccess, &CPUCore::writeBack};
+
+            void cycle() {
+                inst.cycle(clock.tick);
+                passMessage();
+                int order[5] = {0, 1, 2, 3, 4};
+                std::random_shuffle(order, order+5); //simulate parallel
+                for (int i = 0; i < 5; ++i) (this->*stageFunc[order[i]])();
+                clock.clockIn();
+                manage();
+                inst.cycleEnd(clock, regs, bypass, cache);
+            }
 
             void passMessage() {
                 if (!clock.isNotUpdate(ID_Stage)) {
@@ -104,57 +219,162 @@ namespace RISC_V {
                 if (clock.memOver() && htype == ADVANCED::FORWARDING)
                     bypass.update(clock.isStall(EX_Stage), clock.isStall(MEM_Stage));
 
-                //memory 3 cycle
+                prefetcher.tick(clock.tick);
+
+                //memory
+                if (mtype == ADVANCED::NONBLOCKING) storeBuffer.drain(clock.tick), loadQueue.retire(clock.tick);
                 if (bus.memoryAccess) {
                     bus.memoryAccess = false;
-                    clock.memSet(2);
-                    clock.stallRequest(MEM_Stage, 2); //left 2 cycle
-                    //because mem is stalled, the following stages are required to be stalled.
-                    clock.stallRequest(IF_Stage, 2);
-                    clock.stallRequest(ID_Stage, 2);
-                    clock.stallRequest(EX_Stage, 2);
+                    if (mtype == ADVANCED::BLOCKING || memoryMustBlock(EX_MEM)) memoryBlock();
+                }
+                if (bus.vectorAccess) { //vl 已由更早的 vsetvli 在 MEM 中确定
+                    bus.vectorAccess = false;
+                    size_t latency = vector.latency(EX_MEM.IR);
+                    if (latency > 1) memoryBlock(latency - 1);
                 }
 
                 //jump
                 if (bus.isJump) { //jump, clear the IF
-                    pc = bus.tarpc;
                     bus.isJump = false;
-                    IF_ID.clear();
-                    cache.clear();
+                    if (!loopBuffer.followed(lastPC(ID_EX), IF_ID.uid ? IF_ID.pc : pc)) { //循环缓冲锁定时 IF 可能已经跟随了 JAL
+                        pc = bus.tarpc;
+                        inst.flush(clock.tick, IF_ID);
+                        IF_ID.clear();
+                        cache.clear();
+                    }
                 }
                 else if (bus.isBranch && !predictor.nowpc) {
                     bus.predictHit = predictor.predict(ID_EX.pc); //the pc fetch by IF
-                    if (bus.predictHit) pc = bus.tarpc, IF_ID.clear(), cache.clear(); //predict: jump
+                    //循环缓冲锁定时 IF 已经直接取回了循环开头
+                    bool wrapped = loopBuffer.followed(lastPC(ID_EX), IF_ID.uid ? IF_ID.pc : pc);
+                    if (bus.predictHit && !wrapped) { //predict: jump
+                        inst.flush(clock.tick, IF_ID);
+                        pc = bus.tarpc, IF_ID.clear(), cache.clear();
+                    }
+                    else if (!bus.predictHit && wrapped) { //predict: not jump, 退出循环
+                        inst.flush(clock.tick, IF_ID);
+                        pc = ID_EX.pc + ID_EX.IR.size, IF_ID.clear(), cache.clear();
+                    }
                 }
 
                 //data hazard
                 if (htype == ADVANCED::STALL) hazardStallStrategy();
                 else if (htype == ADVANCED::FORWARDING) hazardForwardingStrategy();
+
+                //branch: 冒险检测通过 (没有再要求 ID 重新译码) 说明分支的操作数已经确定
+                if (bus.branchDecoded) {
+                    bus.branchDecoded = false;
+                    if (!clock.isNotUpdate(ID_Stage) && comparator.enabled && bus.isBranch && predictor.nowpc) earlyResolve();
+                }
+            }
+
+            void earlyResolve() { //ID_EX 中的分支由 ID 的比较器确定，EX 不再处理；预测错误时只冲掉 IF 取的一条
+                bool taken = bus.decodeHit;
+                comparator.resolved++;
+                predictor.update(taken);
+                inst.branch(clock.tick, ID_EX.pc, taken, taken ^ bus.predictHit);
+                if (taken ^ bus.predictHit) {
+                    predictor.wrong++;
+                    comparator.mispredict(wrongPath(ID_EX.uid));
+                    inst.flush(clock.tick, IF_ID);
+                    pc = taken ? bus.tarpc : ID_EX.pc + ID_EX.IR.size, IF_ID.clear(), cache.clear();
+                }
+                else predictor.success++;
+                bus.isBranch = bus.delayFlag = bus.predictHit = false;
+            }
+
+            size_t wrongPath(uint32_t branch) const { //IF_ID、ID、ID_EX 中比分支晚取回、预测错误时要冲掉的指令数 (ID 与 ID_EX 可能是同一条)
+                size_t cnt = 0;
+                uint32_t last = 0;
+                for (const BASIC::StageRegister* reg : {&IF_ID, &ID, &ID_EX})
+                    if (reg->uid > branch && reg->uid != last) cnt++, last = reg->uid;
+                return cnt;
+            }
+
+            void fillLoop() { //循环缓冲刚锁定：没走到的指令直接从内存译码补齐，不依赖错误路径上的译码，与分支在哪一阶段确定无关
+                uint32_t at;
+                Instruction ir;
+                while (loopBuffer.hole(at)) {
+                    uint32_t insCode = mem.read(at, 4);
+                    id.decode(insCode, ir);
+                    loopBuffer.capture(at, insCode, ir);
+                }
+            }
+
+            static uint32_t lastPC(const BASIC::StageRegister& reg) { return reg.pc + reg.IR.size - 4; } //融合指令为第二条的地址
+
+            bool fetchWait() { //ICache 缺失时等待行到达（预取命中可少等或不等），返回本周期是否只能空转
+                uint32_t line = cache.line(pc);
+                if (refillLine != line) {
+                    refillLine = line;
+                    refillReady = clock.tick + prefetcher.demand(line, clock.tick);
+                }
+                if (clock.tick < refillReady) return true;
+                refillLine = NO_REFILL;
+                return false;
+            }
+
+            void memoryBlock(size_t ticks = 2) { //memory 3 cycle; 向量指令按其占用 MEM 的周期
+                memBlocked = true;
+                inst.hazard(clock.tick, MEM_Stage, EX_MEM);
+                clock.memSet(ticks);
+                clock.stallRequest(MEM_Stage, ticks); //left 2 cycle
+                //because mem is stalled, the following stages are required to be stalled.
+                clock.stallRequest(IF_Stage, ticks);
+                clock.stallRequest(ID_Stage, ticks);
+                clock.stallRequest(EX_Stage, ticks);
+            }
+
+            bool memoryMustBlock(const BASIC::StageRegister& reg) { //NONBLOCKING 下仍需整条流水线等待的情况
+                if (isLoad(reg.IR.ins)) {
+                    if (storeBuffer.lookup(reg.out, accessBytes(reg.IR.ins)) < 0) { //部分重叠，等 store 写回
+                        storeBuffer.blocked++;
+                        return true;
+                    }
+                    return loadQueue.full();
+                }
+                if (storeBuffer.full()) {
+                    storeBuffer.blocked++;
+                    return true;
+                }
+                return false;
+            }
+
+            bool loadQueueHazard() { //ID_EX 读的寄存器还在等未返回的 load，停一周期后重新译码
+                if (mtype != ADVANCED::NONBLOCKING || !loadQueue.pending(ID_EX.IR, clock.tick - 1)) return false;
+                loadQueue.waitCycles++;
+                clock.stallRequest(EX_Stage);
+                clock.notUpdateRequest(ID_Stage);
+                clock.stallRequest(IF_Stage);
+                return true;
             }
 
             void hazardStallStrategy() {
                 if (!clock.isNotUpdate(ID_Stage)) {
                     bool isHazard = false;
-                    if (MEM_WB.IR.rd && (MEM_WB.IR.rd == ID_EX.IR.rs1 || MEM_WB.IR.rd == ID_EX.IR.rs2)) {
+                    if (readsReg(ID_EX.IR, MEM_WB.IR.rd)) {
                         clock.stallRequest(EX_Stage, 2);
                         clock.stallRequest(ID_Stage);
                         clock.notUpdateRequest(ID_Stage, 2);
                         clock.stallRequest(IF_Stage, 2);
                         isHazard = true;
                     }
-                    if (WB.IR.rd && (WB.IR.rd == ID_EX.IR.rs1 || WB.IR.rd == ID_EX.IR.rs2)) {
+                    if (readsReg(ID_EX.IR, WB.IR.rd)) {
                         clock.stallRequest(EX_Stage);
                         clock.notUpdateRequest(ID_Stage);
                         clock.stallRequest(IF_Stage);
                         isHazard = true;
                     }
-                    if (EX_MEM.IR.rd && (EX_MEM.IR.rd == ID_EX.IR.rs1 || EX_MEM.IR.rd == ID_EX.IR.rs2)) {
+                    if (readsReg(ID_EX.IR, EX_MEM.IR.rd)) {
                         clock.stallRequest(EX_Stage, 3);
                         clock.stallRequest(ID_Stage, 2);
                         clock.notUpdateRequest(ID_Stage, 3);
                         clock.stallRequest(IF_Stage, 3);
                         isHazard = true;
                     }
+                    if (!isHazard) isHazard = loadQueueHazard();
+                    if (isHazard) inst.hazard(clock.tick, ID_Stage, ID_EX);
+                    else if (mtype == ADVANCED::NONBLOCKING) loadQueue.cancel(ID_EX.IR.rd);
                     dataHazard += isHazard;
                 }
             }
@@ -163,23 +383,28 @@ namespace RISC_V {
                 if (!clock.isNotUpdate(ID_Stage)) { //avoid repeat stall
                     bool isHazard = false;
                     //Wait a cycle because it is in MEM
-                    if (isLoad(MEM_WB.IR.ins) && MEM_WB.IR.rd && (MEM_WB.IR.rd == ID_EX.IR.rs1 || MEM_WB.IR.rd == ID_EX.IR.rs2)) {
+                    if (resultInMEM(MEM_WB.IR.ins) && readsReg(ID_EX.IR, MEM_WB.IR.rd)) {
                         clock.stallRequest(EX_Stage);
                         clock.notUpdateRequest(ID_Stage);
                         clock.stallRequest(IF_Stage);
                         isHazard = true;
                     }
                     //EX_MEM
-                    if (EX_MEM.IR.rd && (EX_MEM.IR.rd == ID_EX.IR.rs1 || EX_MEM.IR.rd == ID_EX.IR.rs2)) {
+                    if (readsReg(ID_EX.IR, EX_MEM.IR.rd)) {
                         clock.stallRequest(EX_Stage);
                         clock.notUpdateRequest(ID_Stage);
                         clock.stallRequest(IF_Stage);
                         isHazard = true;
                     }
+                    if (!isHazard) isHazard = loadQueueHazard();
+                    if (isHazard) inst.hazard(clock.tick, ID_Stage, ID_EX);
+                    else if (mtype == ADVANCED::NONBLOCKING) loadQueue.cancel(ID_EX.IR.rd);
                     dataHazard += isHazard;
                 }
             }
     };
+
+    typedef CPUCore<> CPU; //不带插桩的引擎
 }
 
 #endif //RISC_V_SIMULATOR_CPU_CORE_HPP
@@ -6,36 +6,71 @@
 
 namespace RISC_V {
 
-    void CPU::instructionFetch() {
+    template<class Instrument>
+    void CPUCore<Instrument>::instructionFetch() {
         if (clock.isStall(IF_Stage)) return;
-        if (cache.empty()) cache.load(mem.getPool()+pc);
-        IF_ID.insCode = cache.get();
-        IF_ID.pc = pc;
-        pc += 4;
+        uint32_t fetchpc = pc, second = 0;
+        if (loopBuffer.fetch(pc, IF_ID.insCode)) { //循环缓冲锁定，ICache 不参与
+            cache.clear();
+            if (pc == fetchpc + 4 && loopBuffer.peek(pc, second) && fusion.pairs(IF_ID.insCode, second)) loopBuffer.fetch(pc, second);
+            else second = 0;
+        }
+        else {
+            if (cache.empty()) {
+                if (fetchWait()) return; //bubble
+                cache.load(mem.getPool(), pc);
+            }
+            IF_ID.insCode = cache.get();
+            pc += 4;
+            if (cache.peek(second) && fusion.pairs(IF_ID.insCode, second)) cache.get(), pc += 4;
+            else second = 0;
+        }
+        IF_ID.fuseCode = second; //宏融合：同一取指块中的下一条一起取回
+        IF_ID.pc = fetchpc;
+        IF_ID.uid = ++fetched;
         /*
             IF_ID.insCode = mem.read(pc, 4);
             IF_ID.pc = pc;
             pc += 4;
         */
-#ifdef DEBUG
-                MINE("fetch result: " << std::hex << IF_ID.pc << ' ' << IF_ID.insCode);
-#endif
+        inst.stage(clock.tick, IF_Stage, IF_ID);
     }
 
-    void CPU::instructionDecode() {
+    template<class Instrument>
+    void CPUCore<Instrument>::instructionDecode() {
         if (clock.isStall(ID_Stage)) return;
-        id.decode(ID.insCode, ID_EX.IR);
+        if (!loopBuffer.decode(ID.pc, ID.insCode, ID_EX.IR)) {
+            id.decode(ID.insCode, ID_EX.IR);
+            loopBuffer.capture(ID.pc, ID.insCode, ID_EX.IR);
+        }
+        if (ID.fuseCode) { //宏融合：IF 一起取回的下一条
+            Instruction second, fused;
+            if (!loopBuffer.decode(ID.pc + 4, ID.fuseCode, second)) {
+                id.decode(ID.fuseCode, second);
+                loopBuffer.capture(ID.pc + 4, ID.fuseCode, second);
+            }
+            if (fusion.fuse(ID_EX.IR, second, fused)) ID_EX.IR = fused;
+        }
         ID_EX.A = regs.read(ID_EX.IR.rs1);
         ID_EX.B = regs.read(ID_EX.IR.rs2);
+        if (ID_EX.IR.ins == ECALL) {
+            ID_EX.C = regs.read(SYSCALL_ARG1);
+            ID_EX.D = regs.read(SYSCALL_ARG2);
+        }
         if (htype == ADVANCED::FORWARDING) {
             bypass.mux(ID_EX.IR.rs1, ID_EX.A);
             bypass.mux(ID_EX.IR.rs2, ID_EX.B);
+            if (ID_EX.IR.ins == ECALL) {
+                bypass.mux(SYSCALL_ARG1, ID_EX.C);
+                bypass.mux(SYSCALL_ARG2, ID_EX.D);
+            }
         }
         ID_EX.pc = ID.pc; //pass EX old pc, store new pc in tarpc
+        ID_EX.insCode = ID.insCode, ID_EX.uid = ID.uid;
         if (ID_EX.IR.ins == JAL || ID_EX.IR.ins == JALR || id.TypeTable[ID_EX.IR.opcode] == BType) {
             if (ID_EX.IR.ins == JAL) {
                 bus.isJump = true;
-                ID_EX.out = ID_EX.pc + 4;
+                ID_EX.out = ID_EX.pc + ID_EX.IR.size;
                 alu.input(ID_EX.pc, ID_EX.IR.imm, '+');
                 bus.tarpc = alu.ALUOut;
             } else if (ID_EX.IR.ins == JALR) {
@@ -45,18 +80,18 @@ namespace RISC_V {
                 bus.tarpc = alu.ALUOut & ~1;
             } else {
                 if (bus.isBranch) bus.delayFlag = true;
-                bus.isBranch = true;
+                bus.isBranch = bus.branchDecoded = true;
+                if (comparator.enabled) bus.decodeHit = comparator.taken(ID_EX.IR, ID_EX.A, ID_EX.B);
                 alu.input(ID_EX.pc, ID_EX.IR.imm, '+');
                 bus.tarpc = alu.ALUOut;
             }
+            prefetcher.branchTarget(bus.tarpc);
         }
-#ifdef DEBUG
-                MINE("decode result: " << std::dec << insName[ID_EX.IR.ins] << " imm:" << ID_EX.IR.imm << " rd:" <<
-                        ID_EX.IR.rd << " rs1: " << ID_EX.IR.rs1 << " A:" << ID_EX.A << " rs2: " << ID_EX.IR.rs2 <<  " B:" << ID_EX.B << " shamt:" << ID_EX.IR.shamt)
-#endif
+        inst.stage(clock.tick, ID_Stage, ID_EX);
     }
 
-    void CPU::execute() {
+    template<class Instrument>
+    void CPUCore<Instrument>::execute() {
         if (clock.isStall(EX_Stage)) return;
         EX_MEM = EX;
         bus.branchHit = false;
@@ -173,19 +208,34 @@ namespace RISC_V {
                 alu.input(EX.A, EX.B, '&');
                 EX_MEM.out = alu.ALUOut;
             }break;
+            case SHADD:{
+                alu.input(EX.A, EX.IR.shamt, '<');
+                alu.input(alu.ALUOut, EX.B, '+');
+                EX_MEM.out = alu.ALUOut;
+            }break;
+            case CMPBR:{
+                alu.input(EX.A, EX.B, '-', !(EX.IR.funct3 & 1));
+                EX_MEM.out = alu.neg;
+                if (alu.neg != bool(EX.IR.funct3 & 2)) bus.branchHit = true;
+            }break;
         }
-        if (!isLoad(EX.IR.ins))
+        if (isVector(EX.IR.ins)) bus.vectorAccess = true;
+        if (!resultInMEM(EX.IR.ins))
             bypass.send(EX.IR.rd, EX_MEM.out, EX_Stage);
+        uint32_t nextpc = EX.pc + EX.IR.size; //EX_MEM.pc 保留指令自身的地址，供提交时使用
         if (bus.branchHit) {
             alu.input(EX.pc, EX.IR.imm, '+');
-            EX_MEM.pc = alu.ALUOut;
+            nextpc = alu.ALUOut;
+            if (loopBuffer.taken(EX.pc + EX.IR.size - 4, nextpc)) fillLoop(); //融合的 CMPBR 按其中分支的地址
         }
-        else EX_MEM.pc = EX.pc + 4;
         if (bus.isBranch && predictor.nowpc > 0) {
             predictor.update(bus.branchHit);
+            inst.branch(clock.tick, EX.pc, bus.branchHit, bus.branchHit ^ bus.predictHit);
             if (bus.branchHit ^ bus.predictHit) { //Wrong Predict
                 predictor.wrong++;
-                pc = EX_MEM.pc; //EX_MEM.pc is the correct pc
+                comparator.mispredict(wrongPath(EX.uid));
+                pc = nextpc; //the correct pc
+                inst.flush(clock.tick, IF_ID), inst.flush(clock.tick, ID), inst.flush(clock.tick, ID_EX);
                 IF_ID.clear(); //clear pipeline, last IF, this ID is meaningless
                 ID.clear();
                 ID_EX.clear();
@@ -198,13 +248,11 @@ namespace RISC_V {
                 else bus.delayFlag = false;
             }
         }
-#ifdef DEBUG
-                MINE("execute result: " << insName[EX.IR.ins] << " imm:" << EX.IR.imm
-                << " rs1:" << EX.IR.rs1 << " A:" << EX.A << " rs2:" << EX.IR.rs2 << " B:" << EX.B << " ALUOut:" << EX_MEM.out << " pc:" << EX_MEM.pc)
-#endif
+        inst.stage(clock.tick, EX_Stage, EX_MEM);
     }
 
-    void CPU::memoryAccess() {
+    template<class Instrument>
+    void CPUCore<Instrument>::memoryAccess() {
         if (clock.isStall(MEM_Stage)) return;
         MEM_WB = MEM;
         switch (MEM.IR.ins) {
@@ -232,18 +280,43 @@ namespace RISC_V {
             case SW:
                 mem.write(MEM.out, MEM.B, 4);
                 break;
+            case ECALL: //在 MEM 执行：更早的 store 都已完成，分支也都已确定
+                MEM_WB.out = sys.call(mem, clock.tick, MEM.A, MEM.B, MEM.C, MEM.D);
+                break;
+        }
+        if (isLoad(MEM.IR.ins) || isStore(MEM.IR.ins)) inst.memory(clock.tick, MEM.out, accessBytes(MEM.IR.ins), isStore(MEM.IR.ins));
+        if (isVector(MEM.IR.ins)) { //在 MEM 按程序顺序执行，之前的 store 都已写入内存
+            MEM_WB.out = vector.execute(MEM.IR, MEM.A, MEM.B, vregs, mem);
+            if (MEM.IR.ins >= VLE32 && MEM.IR.ins <= VSSE32) inst.memory(clock.tick, MEM.A, 4 * vector.vl, MEM.IR.ins >= VSE32);
+        }
+        if (memBlocked) memBlocked = false; //已经等过完整的访存延迟
+        else if (mtype == ADVANCED::NONBLOCKING) { //只计时，数据在上面已经读写完成
+            if (isStore(MEM.IR.ins)) storeBuffer.push(MEM.out, accessBytes(MEM.IR.ins), clock.tick);
+            else if (isLoad(MEM.IR.ins)) {
+                if (storeBuffer.lookup(MEM.out, accessBytes(MEM.IR.ins)) > 0) storeBuffer.forwarded++;
+                else loadQueue.push(MEM.IR.rd, clock.tick + ADVANCED::MEM_LATENCY);
+            }
         }
         bypass.send(MEM_WB.IR.rd, MEM_WB.out, MEM_Stage);
-#ifdef DEBUG
-                MINE("memory access result: " << insName[MEM.IR.ins] << " rd: " << MEM.IR.rd << " output:" << MEM_WB.out)
-#endif
+        inst.stage(clock.tick, MEM_Stage, MEM_WB);
     }
 
-    void CPU::writeBack() {
+    template<class Instrument>
+    void CPUCore<Instrument>::writeBack() {
         if (clock.isStall(WB_Stage)) return;
         regs.write(WB.IR.rd, WB.out);
-#ifdef DEBUG
-                MINE("write back result: " << insName[WB.IR.ins] << " rd: " << WB.IR.rd << " output:" << WB.out)
-#endif
+        if (WB.IR.ins != NOP) {
+            retired += WB.IR.size >> 2, retiredPC = WB.pc, retiredEnd = WB.pc + WB.IR.size;
+            fusion.retire(WB.IR);
+            inst.retire(clock.tick, WB);
+        }
+        inst.stage(clock.tick, WB_Stage, WB);
     }
+
+    //cpu_stages.cpp 之外只能使用这里实例化过的引擎
+    template class CPUCore<INSTRUMENT::Null>;
+    template class CPUCore<INSTRUMENT::Statistics>;
+    template class CPUCore<INSTRUMENT::KonataTrace>;
+    template class CPUCore<INSTRUMENT::Combine<INSTRUMENT::KonataTrace, INSTRUMENT::Statistics>>;
+    template class CPUCore<INSTRUMENT::DebugDump>;
 }
\ No newline at end of file
@@ -23,6 +23,16 @@ namespace RISC_V {
                     ret.ins = HALT;
                     return;
                 }
+                if (insCode == 0x00000073) {//ecall: a7 调用号, a0-a2 参数, 返回值写回 a0
+                    ret.ins = ECALL;
+                    ret.rs1 = SYSCALL_NUMBER;
+                    ret.rs2 = ret.rd = FUNCTION_RETURN;
+                    return;
+                }
+                if (ret.opcode == 0b1010111 || ret.opcode == 0b0000111 || ret.opcode == 0b0100111) {
+                    decodeVector(insCode, ret);
+                    return;
+                }
                 switch (TypeTable[ret.opcode]) {
                     case RType: {
                         ret.rd = slice(insCode, 7, 11);
@@ -75,10 +85,70 @@ namespace RISC_V {
                 ret.ins = InstructionTable[(Triple) {ret.opcode, ret.funct3, ret.funct7}];
             }
 
+            //RVV 子集：只支持 e32、LMUL=1、不带掩码 (vm=1)，其余编码译成 NOP
+            void decodeVector(uint32_t insCode, Instruction &ret) {
+                uint32_t funct3 = slice(insCode, 12, 14), field1 = slice(insCode, 15, 19), field2 = slice(insCode, 20, 24);
+                uint32_t funct6 = slice(insCode, 26, 31);
+                bool masked = !slice(insCode, 25, 25);
+                if (ret.opcode == 0b1010111 && funct3 == OPCFG) { //vsetvli rd, rs1, vtypei
+                    if (slice(insCode, 31, 31)) return; //vsetivli / vsetvl
+                    ret.ins = VSETVLI;
+                    ret.rd = slice(insCode, 7, 11);
+                    ret.rs1 = field1;
+                    ret.imm = slice(insCode, 20, 30);
+                    return;
+                }
+                if (masked) return;
+                ret.vd = slice(insCode, 7, 11);
+                if (ret.opcode != 0b1010111) { //vle32 / vlse32 / vse32 / vsse32: nf=0, mew=0, width=32
+                    uint32_t mop = slice(insCode, 26, 27);
+                    if (funct3 != 0b110 || slice(insCode, 28, 31) || (mop != 0 && mop != 2) || (mop == 0 && field2)) return;
+                    bool load = ret.opcode == 0b0000111;
+                    ret.ins = mop ? (load ? VLSE32 : VSSE32) : (load ? VLE32 : VSE32);
+                    ret.rs1 = field1;
+                    if (mop) ret.rs2 = field2; //stride
+                    return;
+                }
+                ret.funct3 = funct3, ret.vs2 = field2;
+                switch (funct3) {
+                    case OPIVV: ret.vs1 = field1; break;
+                    case OPIVX: ret.rs1 = field1; break;
+                    case OPIVI: ret.imm = sext(field1, 4); break;
+                    case OPMVV: ret.vs1 = field1; break;
+                    case OPMVX: ret.rs1 = field1; break;
+                    default: return;
+                }
+                if (funct3 == OPMVV || funct3 == OPMVX) {
+                    if (funct6 == 0b010000) { //vmv.x.s / vmv.s.x
+                        if (funct3 == OPMVV && !field1) ret.ins = VMVXS, ret.rd = ret.vd, ret.vd = ret.vs1 = 0;
+                        else if (funct3 == OPMVX && !field2) ret.ins = VMVSX;
+                    }
+                    else if (funct6 == 0b100101) ret.ins = VMUL;
+                    else if (funct3 == OPMVV && VectorReductionTable.count(funct6)) ret.ins = VectorReductionTable[funct6];
+                }
+                else if (VectorIntegerTable.count(funct6)) {
+                    ret.ins = VectorIntegerTable[funct6];
+                    if (ret.ins == VMV && field2) ret.ins = NOP; //vmerge
+                }
+                if (ret.ins == NOP) ret.init();
+            }
+
+            std::map <uint32_t, InsType> VectorIntegerTable = { //OPIVV/OPIVX/OPIVI funct6 -> ins
+                    {0b000000, VADD}, {0b000010, VSUB}, {0b000011, VRSUB}, {0b000100, VMINU}, {0b000101, VMIN},
+                    {0b000110, VMAXU}, {0b000111, VMAX}, {0b001001, VAND}, {0b001010, VOR}, {0b001011, VXOR},
+                    {0b010111, VMV}, {0b100101, VSLL}, {0b101000, VSRL}, {0b101001, VSRA}
+            };
+
+            std::map <uint32_t, InsType> VectorReductionTable = { //OPMVV funct6 -> ins
+                    {0b000000, VREDSUM}, {0b000001, VREDAND}, {0b000010, VREDOR}, {0b000011, VREDXOR},
+                    {0b000100, VREDMINU}, {0b000101, VREDMIN}, {0b000110, VREDMAXU}, {0b000111, VREDMAX}
+            };
+
             std::map <uint32_t, InsFormatType> TypeTable = { //opcode -> type
                     {0b0110111, UType},
                     {0b0010111, UType},
                     {0b1101111, JType},
+                    {0b1100111, IType}, //jalr，立即数不为 0 时也要正确译码
                     {0b1100011, BType},
                     {0b0000011, IType},
                     {0b0100011, SType},
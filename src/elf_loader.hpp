@@ -0,0 +1,99 @@
+#ifndef RISC_V_SIMULATOR_ELF_LOADER_HPP
+#define RISC_V_SIMULATOR_ELF_LOADER_HPP
+
+#include "include.hpp"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace RISC_V {
+    class SymbolTable { //函数地址 -> 函数名，供 trace / profiler 显示
+    private:
+        std::map<uint32_t, std::string> table;
+    public:
+        void insert(uint32_t addr, const std::string& name) { table[addr] = name; }
+
+        void clear() { table.clear(); }
+
+        bool empty() const { return table.empty(); }
+
+        std::string lookup(uint32_t pc) const { //"func+0x10"，找不到返回空串
+            auto it = table.upper_bound(pc);
+            if (it == table.begin()) return "";
+            --it;
+            if (pc == it->first) return it->second;
+            std::stringstream trans;
+            trans << it->second << "+0x" << std::hex << pc - it->first;
+            return trans.str();
+        }
+    };
+
+    /*
+     * 静态链接的 RV32 ELF 可执行文件加载器
+     * 把 PT_LOAD 段写入内存池（一个单元一个字节），记录入口地址与符号表
+     */
+    class ELFLoader {
+    private:
+        const std::string& image;
+
+        uint32_t read(size_t pos, size_t bytes) const {
+            if (pos + bytes > image.size()) throw std::runtime_error("ELF: truncated file");
+            uint32_t ret = 0;
+            for (int i = pos + bytes - 1; i >= signed(pos); --i)
+                ret = (ret << 8) + uint8_t(image[i]);
+            return ret;
+        }
+
+        enum {PT_LOAD = 1, SHT_SYMTAB = 2, STT_NOTYPE = 0, STT_FUNC = 2, EM_RISCV = 243};
+
+    public:
+        uint32_t entry, end; //end: 已加载段的最高地址, 即初始 program break
+        std::vector<std::pair<uint32_t, uint32_t>> segments; //已加载段的 (vaddr, memsz)
+
+        explicit ELFLoader(const std::string& _image) : image(_image), entry(0), end(0) {}
+
+        static bool isELF(const std::string& image) {
+            return image.size() >= 4 && image.compare(0, 4, "\x7f" "ELF") == 0;
+        }
+
+        void load(uint32_t* pool, size_t poolSize, SymbolTable& symbols) {
+            if (!isELF(image)) throw std::runtime_error("ELF: bad magic");
+            if (read(4, 1) != 1 || read(5, 1) != 1) throw std::runtime_error("ELF: only ELF32 little-endian is supported");
+            if (read(18, 2) != EM_RISCV) throw std::runtime_error("ELF: not a RISC-V executable");
+            entry = read(24, 4);
+
+            uint32_t phoff = read(28, 4), phentsize = read(42, 2), phnum = read(44, 2);
+            for (uint32_t i = 0; i < phnum; ++i) {
+                size_t ph = phoff + i * phentsize;
+                if (read(ph, 4) != PT_LOAD) continue;
+                uint32_t offset = read(ph + 4, 4), vaddr = read(ph + 8, 4), filesz = read(ph + 16, 4), memsz = read(ph + 20, 4);
+                if (size_t(vaddr) + memsz > poolSize) throw std::runtime_error("ELF: segment exceeds simulator memory");
+                if (size_t(offset) + filesz > image.size()) throw std::runtime_error("ELF: truncated segment");
+                for (uint32_t j = 0; j < filesz; ++j) pool[vaddr + j] = uint8_t(image[offset + j]);
+                for (uint32_t j = filesz; j < memsz; ++j) pool[vaddr + j] = 0; //.bss
+                end = std::max(end, vaddr + memsz);
+                segments.push_back(std::make_pair(vaddr, memsz));
+            }
+
+            symbols.clear();
+            uint32_t shoff = read(32, 4), shentsize = read(46, 2), shnum = read(48, 2);
+            for (uint32_t i = 0; i < shnum; ++i) {
+                size_t sh = shoff + i * shentsize;
+                if (read(sh + 4, 4) != SHT_SYMTAB) continue;
+                uint32_t symoff = read(sh + 16, 4), symsize = read(sh + 20, 4), link = read(sh + 24, 4), entsize = read(sh + 36, 4);
+                size_t strsh = shoff + link * shentsize;
+                uint32_t stroff = read(strsh + 16, 4), strsize = read(strsh + 20, 4);
+                for (uint32_t s = 0; entsize && s + entsize <= symsize; s += entsize) {
+                    size_t sym = symoff + s;
+                    uint32_t name = read(sym, 4), value = read(sym + 4, 4), type = read(sym + 12, 1) & 0xf, shndx = read(sym + 14, 2);
+                    if (!name || !shndx || name >= strsize || (type != STT_FUNC && type != STT_NOTYPE)) continue;
+                    read(stroff + name, 1); //bounds check
+                    std::string str(image.c_str() + stroff + name);
+                    if (!str.empty() && str[0] != '.' && str[0] != '$') symbols.insert(value, str); //跳过 .L 局部标签与映射符号
+                }
+            }
+        }
+    };
+}
+
+#endif //RISC_V_SIMULATOR_ELF_LOADER_HPP
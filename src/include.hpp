@@ -19,32 +19,44 @@
 #define BOMB std::cout<<"bomb\n";
 #define MINE(_x) std::cout<<_x<<'\n';
 
-//#define DEBUG
-#define LOCAL
-
 namespace RISC_V {
-    const size_t REG_N = 32, MEM_SIZE = 500000, FUNCTION_RETURN = 10, RETURN_ADDRESS = 1;
+    const size_t REG_N = 32, VLEN = 512, VLMAX = VLEN / 32, MEM_SIZE = 500000, FUNCTION_RETURN = 10, RETURN_ADDRESS = 1, STACK_POINTER = 2,
+                 SYSCALL_NUMBER = 17, SYSCALL_ARG1 = 11, SYSCALL_ARG2 = 12;
 
     enum InsType {NOP, HALT, LUI, AUIPC, JAL, JALR, BEQ, BNE, BLT, BGE, BLTU, BGEU, LB, LH, LW, LBU,
         LHU, SB, SH, SW, ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI, ADD,
-        SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND};
+        SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND, ECALL,
+        SHADD, CMPBR, //宏融合产生的内部操作，见 ADVANCED::MacroFusion
+        VSETVLI, VLE32, VLSE32, VSE32, VSSE32, VADD, VSUB, VRSUB, VAND, VOR, VXOR, VSLL, VSRL, VSRA,
+        VMIN, VMINU, VMAX, VMAXU, VMUL, VMV, VREDSUM, VREDAND, VREDOR, VREDXOR, VREDMIN, VREDMINU,
+        VREDMAX, VREDMAXU, VMVXS, VMVSX}; //RVV 子集，见 ADVANCED::VectorUnit
     enum InsFormatType {RType, IType, SType, BType, UType, JType};
+    enum VectorOperand {OPIVV = 0b000, OPMVV = 0b010, OPIVI = 0b011, OPIVX = 0b100, OPMVX = 0b110, OPCFG = 0b111}; //OP-V 的 funct3
     enum StageType {IF_Stage, ID_Stage, EX_Stage, MEM_Stage, WB_Stage};
 
     const std::string insName[] = {"NOP", "END", "LUI", "AUIPC", "JAL", "JALR", "BEQ", "BNE", "BLT", "BGE", "BLTU", "BGEU", "LB", "LH", "LW", "LBU",
                                    "LHU", "SB", "SH", "SW", "ADDI", "SLTI", "SLTIU", "XORI", "ORI", "ANDI", "SLLI", "SRLI", "SRAI", "ADD",
-                                   "SUB", "SLL", "SLT", "SLTU", "XOR", "SRL", "SRA", "OR", "AND"};
+                                   "SUB", "SLL", "SLT", "SLTU", "XOR", "SRL", "SRA", "OR", "AND", "ECALL",
+                                   "SHADD", "CMPBR",
+                                   "VSETVLI", "VLE32", "VLSE32", "VSE32", "VSSE32", "VADD", "VSUB", "VRSUB", "VAND", "VOR", "VXOR", "VSLL", "VSRL", "VSRA",
+                                   "VMIN", "VMINU", "VMAX", "VMAXU", "VMUL", "VMV", "VREDSUM", "VREDAND", "VREDOR", "VREDXOR", "VREDMIN", "VREDMINU",
+                                   "VREDMAX", "VREDMAXU", "VMVXS", "VMVSX"};
+    const size_t INS_N = sizeof(insName) / sizeof(insName[0]);
 
     struct Instruction { //指令结构体
         InsType ins;
         uint32_t opcode, rd, rs1, rs2, imm, funct3, funct7, shamt;
-        Instruction():ins(NOP),opcode(0),rd(0),rs1(0),rs2(0),imm(0),funct3(0),funct7(0),shamt(0){}
+        uint32_t size; //占的字节数，两条融合成一条时为 8
+        uint32_t vd, vs1, vs2; //向量寄存器 (store 的数据来源也放在 vd)，rd/rs1/rs2 只表示通用寄存器
+        Instruction():ins(NOP),opcode(0),rd(0),rs1(0),rs2(0),imm(0),funct3(0),funct7(0),shamt(0),size(4),vd(0),vs1(0),vs2(0){}
         void init() {
-            ins = NOP, opcode = rd = rs1 = rs2 = imm = funct3 = funct7 = shamt = 0;
+            ins = NOP, opcode = rd = rs1 = rs2 = imm = funct3 = funct7 = shamt = vd = vs1 = vs2 = 0;
+            size = 4;
         }
         bool operator == (const Instruction& obj) const {
             return ins == obj.ins && opcode == obj.opcode && rs1 == obj.rs1 && rs2 == obj.rs2 && imm == obj.imm &&
-            funct3 == obj.funct3 && funct7 == obj.funct7 && shamt == obj.shamt;
+            funct3 == obj.funct3 && funct7 == obj.funct7 && shamt == obj.shamt && size == obj.size &&
+            vd == obj.vd && vs1 == obj.vs1 && vs2 == obj.vs2;
         }
     };
 
@@ -73,6 +85,28 @@ namespace RISC_V {
     static bool isLoad(InsType ins) {
         return ins == LB || ins == LH || ins == LW || ins == LBU || ins == LHU;
     }
+
+    static bool isStore(InsType ins) {
+        return ins == SB || ins == SH || ins == SW;
+    }
+
+    static uint32_t accessBytes(InsType ins) { //load/store 访问的字节数
+        if (ins == LB || ins == LBU || ins == SB) return 1;
+        if (ins == LH || ins == LHU || ins == SH) return 2;
+        return 4;
+    }
+
+    static bool isVector(InsType ins) { return ins >= VSETVLI && ins <= VMVSX; }
+
+    static bool resultInMEM(InsType ins) { //结果在 MEM 阶段才产生，不能从 EX 前传 (向量指令都在 MEM 执行)
+        return isLoad(ins) || ins == ECALL || ins == VSETVLI || ins == VMVXS;
+    }
+
+    static bool readsReg(const Instruction& ir, uint32_t rd) { //ir 是否读寄存器 rd (ECALL 还隐式读 a1, a2)
+        if (!rd) return false;
+        if (rd == ir.rs1 || rd == ir.rs2) return true;
+        return ir.ins == ECALL && (rd == SYSCALL_ARG1 || rd == SYSCALL_ARG2);
+    }
 }
 
 #endif //RISC_V_SIMULATOR_INCLUDE_HPP
@@ -0,0 +1,224 @@
+#ifndef RISC_V_SIMULATOR_INSTRUMENT_HPP
+#define RISC_V_SIMULATOR_INSTRUMENT_HPP
+
+#include "basic_components.hpp"
+#include "advanced_components.hpp"
+#include "pipeline_trace.hpp"
+#include <vector>
+
+namespace RISC_V {
+    /*
+     * 插桩策略：作为 CPUCore 的模板参数，CPU 在流水线的关键位置调用其钩子
+     * Null 的钩子全部为空，内联后不留下任何代码；其余策略从 Null 派生，只覆盖需要的钩子
+     * 用 Combine<A, B> 把多个策略组合起来，新的组合需在 cpu_stages.cpp 末尾显式实例化
+     */
+    namespace INSTRUMENT {
+        struct Null {
+            void setSymbols(const SymbolTable* /*symbols*/) {}
+            void setTracer(TRACE::PipelineTracer* /*tracer*/) {}
+
+            void cycle(size_t /*tick*/) {} //每周期开始
+            void cycleEnd(const BASIC::Clock& /*clock*/, const BASIC::Registers& /*regs*/, const ADVANCED::Bypass& /*bypass*/,
+                          const ADVANCED::ICache<16>& /*cache*/) {}
+            void stage(size_t /*tick*/, StageType /*stage*/, const BASIC::StageRegister& /*reg*/) {} //reg 为该阶段本周期的输出
+            void hazard(size_t /*tick*/, StageType /*stage*/, const BASIC::StageRegister& /*reg*/) {} //ID: 数据冒险, MEM: 访存阻塞
+            void branch(size_t /*tick*/, uint32_t /*pc*/, bool /*taken*/, bool /*mispredict*/) {} //分支确定 (EX，开启 BranchComparator 时为 ID)
+            void memory(size_t /*tick*/, uint32_t /*addr*/, uint32_t /*bytes*/, bool /*store*/) {}
+            void flush(size_t /*tick*/, const BASIC::StageRegister& /*reg*/) {} //被冲刷掉的指令
+            void retire(size_t /*tick*/, const BASIC::StageRegister& /*reg*/) {}
+
+            void display() {}
+        };
+
+        template<class A, class B>
+        struct Combine : A, B {
+            void setSymbols(const SymbolTable* symbols) { A::setSymbols(symbols), B::setSymbols(symbols); }
+            void setTracer(TRACE::PipelineTracer* tracer) { A::setTracer(tracer), B::setTracer(tracer); }
+
+            void cycle(size_t tick) { A::cycle(tick), B::cycle(tick); }
+            void cycleEnd(const BASIC::Clock& clock, const BASIC::Registers& regs, const ADVANCED::Bypass& bypass,
+                          const ADVANCED::ICache<16>& cache) {
+                A::cycleEnd(clock, regs, bypass, cache), B::cycleEnd(clock, regs, bypass, cache);
+            }
+            void stage(size_t tick, StageType stage, const BASIC::StageRegister& reg) {
+                A::stage(tick, stage, reg), B::stage(tick, stage, reg);
+            }
+            void hazard(size_t tick, StageType stage, const BASIC::StageRegister& reg) {
+                A::hazard(tick, stage, reg), B::hazard(tick, stage, reg);
+            }
+            void branch(size_t tick, uint32_t pc, bool taken, bool mispredict) {
+                A::branch(tick, pc, taken, mispredict), B::branch(tick, pc, taken, mispredict);
+            }
+            void memory(size_t tick, uint32_t addr, uint32_t bytes, bool store) {
+                A::memory(tick, addr, bytes, store), B::memory(tick, addr, bytes, store);
+            }
+            void flush(size_t tick, const BASIC::StageRegister& reg) { A::flush(tick, reg), B::flush(tick, reg); }
+            void retire(size_t tick, const BASIC::StageRegister& reg) { A::retire(tick, reg), B::retire(tick, reg); }
+
+            void display() { A::display(), B::display(); }
+        };
+
+        class Counter : public Null { //指令组成与各类事件的计数
+        private:
+            size_t insCount[INS_N], busy[5], hazards[5], branches, mispredicts, loads, stores, flushed;
+        public:
+            Counter() : branches(0), mispredicts(0), loads(0), stores(0), flushed(0) {
+                memset(insCount, 0, sizeof(insCount));
+                memset(busy, 0, sizeof(busy));
+                memset(hazards, 0, sizeof(hazards));
+            }
+
+            void stage(size_t /*tick*/, StageType stage, const BASIC::StageRegister& reg) { if (reg.uid) busy[stage]++; }
+            void hazard(size_t /*tick*/, StageType stage, const BASIC::StageRegister& /*reg*/) { hazards[stage]++; }
+            void branch(size_t /*tick*/, uint32_t /*pc*/, bool /*taken*/, bool mispredict) { branches++, mispredicts += mispredict; }
+            void memory(size_t /*tick*/, uint32_t /*addr*/, uint32_t /*bytes*/, bool store) { store ? stores++ : loads++; }
+            void flush(size_t /*tick*/, const BASIC::StageRegister& reg) { flushed += reg.uid != 0; }
+            void retire(size_t /*tick*/, const BASIC::StageRegister& reg) { insCount[reg.IR.ins]++; }
+
+            void display() {
+                const char* stageName[5] = {"IF", "ID", "EX", "MEM", "WB"};
+                std::cout << "* Counter *" << '\n';
+                std::cout << "Branches:" << branches << ", Mispredicts:" << mispredicts << ", Flushed:" << flushed
+                          << ", Loads:" << loads << ", Stores:" << stores << '\n';
+                std::cout << "Busy (non-bubble) cycles:";
+                for (int i = 0; i < 5; ++i) std::cout << ' ' << stageName[i] << ':' << busy[i];
+                std::cout << '\n' << "Stall events: ID:" << hazards[ID_Stage] << " MEM:" << hazards[MEM_Stage] << '\n';
+                std::cout << "Instruction mix:";
+                for (size_t i = 0; i < INS_N; ++i) if (insCount[i]) std::cout << ' ' << insName[i] << ':' << insCount[i];
+                std::cout << '\n';
+            }
+        };
+
+        class Profiler : public Null { //按 pc / 函数统计提交数与停顿，找热点
+        private:
+            struct Entry {
+                size_t retired, stalls, mispredicts;
+            };
+            std::unordered_map<uint32_t, Entry> table;
+            const SymbolTable* symbols;
+
+            static const size_t TOP = 10;
+
+            static void print(const std::string& name, const Entry& e) {
+                std::cout << std::setw(28) << std::left << name << std::right << " retired:" << e.retired
+                          << " stalls:" << e.stalls << " mispredicts:" << e.mispredicts << '\n';
+            }
+
+            static void top(std::vector<std::pair<std::string, Entry>>& list) {
+                std::sort(list.begin(), list.end(), [](const std::pair<std::string, Entry>& a, const std::pair<std::string, Entry>& b) {
+                    return a.second.retired + a.second.stalls > b.second.retired + b.second.stalls;
+                });
+                for (size_t i = 0; i < list.size() && i < TOP; ++i) print(list[i].first, list[i].second);
+            }
+
+        public:
+            Profiler() : symbols(nullptr) {}
+
+            void setSymbols(const SymbolTable* _symbols) { symbols = _symbols; }
+
+            void hazard(size_t /*tick*/, StageType /*stage*/, const BASIC::StageRegister& reg) { if (reg.uid) table[reg.pc].stalls++; }
+            void branch(size_t /*tick*/, uint32_t pc, bool /*taken*/, bool mispredict) { table[pc].mispredicts += mispredict; }
+            void retire(size_t /*tick*/, const BASIC::StageRegister& reg) { table[reg.pc].retired++; }
+
+            void display() {
+                std::cout << "* Profiler *" << '\n';
+                std::vector<std::pair<std::string, Entry>> list;
+                for (auto& it : table) {
+                    std::stringstream trans;
+                    trans << "0x" << std::hex << it.first;
+                    list.push_back(std::make_pair(trans.str(), it.second));
+                }
+                top(list);
+                if (!symbols || symbols->empty()) return;
+                std::map<std::string, Entry> func; //按函数汇总
+                for (auto& it : table) {
+                    std::string name = symbols->lookup(it.first);
+                    Entry& e = func[name.empty() ? "?" : name.substr(0, name.find('+'))];
+                    e.retired += it.second.retired, e.stalls += it.second.stalls, e.mispredicts += it.second.mispredicts;
+                }
+                list.assign(func.begin(), func.end());
+                std::cout << "- by function -" << '\n';
+                top(list);
+            }
+        };
+
+        class KonataTrace : public Null { //输出 Konata 流水线图，见 pipeline_trace.hpp
+        private:
+            TRACE::PipelineTracer* tracer;
+            const SymbolTable* symbols;
+            bool on; //本周期是否在记录窗口内
+        public:
+            KonataTrace() : tracer(nullptr), symbols(nullptr), on(false) {}
+
+            void setSymbols(const SymbolTable* _symbols) {
+                symbols = _symbols;
+                if (tracer) tracer->setSymbols(symbols);
+            }
+
+            void setTracer(TRACE::PipelineTracer* _tracer) { //nullptr 时停止记录
+                tracer = _tracer;
+                if (tracer) tracer->setSymbols(symbols);
+            }
+
+            void cycle(size_t tick) {
+                on = false;
+                if (tracer) tracer->tick(tick), on = tracer->on;
+            }
+
+            void stage(size_t tick, StageType stage, const BASIC::StageRegister& reg) {
+                if (!on) return;
+                tracer->record(stage == IF_Stage ? TRACE::FETCH : TRACE::STAGE, tick, reg.uid, reg.pc, reg.insCode, stage);
+                if (stage == ID_Stage) tracer->record(TRACE::LABEL, tick, reg.uid, reg.pc, reg.IR.ins);
+                if (stage == WB_Stage) tracer->record(TRACE::RETIRE, tick, reg.uid, reg.pc, reg.insCode);
+            }
+
+            void hazard(size_t tick, StageType stage, const BASIC::StageRegister& reg) {
+                if (on) tracer->record(TRACE::STALL, tick, reg.uid, reg.pc, reg.insCode, stage);
+            }
+
+            void flush(size_t tick, const BASIC::StageRegister& reg) {
+                if (on) tracer->record(TRACE::FLUSH, tick, reg.uid, reg.pc, reg.insCode);
+            }
+        };
+
+        class DebugDump : public Null { //逐周期打印各阶段结果与寄存器，输出量很大
+        public:
+            void cycle(size_t tick) { MINE("tick: " << tick) }
+
+            void cycleEnd(const BASIC::Clock& clock, const BASIC::Registers& regs, const ADVANCED::Bypass& bypass,
+                          const ADVANCED::ICache<16>& cache) {
+                std::cout << "IF:" << clock.stall[0] << " ID:" << clock.stall[1] << " EX:" << clock.stall[2] << " MEM:" << clock.stall[3] << " WB:" << clock.stall[4] << '\n';
+                cache.display();
+                bypass.display();
+                regs.display();
+            }
+
+            void stage(size_t /*tick*/, StageType stage, const BASIC::StageRegister& reg) {
+                const Instruction& ir = reg.IR;
+                switch (stage) {
+                    case IF_Stage:
+                        MINE("fetch result: " << std::hex << reg.pc << ' ' << reg.insCode << std::dec)
+                        break;
+                    case ID_Stage:
+                        MINE("decode result: " << std::dec << insName[ir.ins] << " imm:" << ir.imm << " rd:" << ir.rd
+                             << " rs1: " << ir.rs1 << " A:" << reg.A << " rs2: " << ir.rs2 << " B:" << reg.B << " shamt:" << ir.shamt)
+                        break;
+                    case EX_Stage:
+                        MINE("execute result: " << insName[ir.ins] << " imm:" << ir.imm << " rs1:" << ir.rs1 << " A:" << reg.A
+                             << " rs2:" << ir.rs2 << " B:" << reg.B << " ALUOut:" << reg.out << " pc:" << reg.pc)
+                        break;
+                    case MEM_Stage:
+                        MINE("memory access result: " << insName[ir.ins] << " rd: " << ir.rd << " output:" << reg.out)
+                        break;
+                    case WB_Stage:
+                        MINE("write back result: " << insName[ir.ins] << " rd: " << ir.rd << " output:" << reg.out)
+                        break;
+                }
+            }
+        };
+
+        typedef Combine<Counter, Profiler> Statistics;
+    }
+}
+
+#endif //RISC_V_SIMULATOR_INSTRUMENT_HPP
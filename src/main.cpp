@@ -1,21 +1,93 @@
 #include "cpu_core.hpp"
+#include <memory>
+#include <fstream>
 
-int main() {
-    using namespace RISC_V;
-    using namespace ADVANCED;
+using namespace RISC_V;
+using namespace ADVANCED;
 
-#ifdef DEBUG
-    BASIC::ALU alu;
-    alu.input(0xbc8f0000, 1, '>', true);
-    std::cout << std::hex << alu.ALUOut << '\n';
-    std::cout << "Hello, RISCV!" << std::endl;
-    //freopen("testcases/array_test1.data", "r", stdin);
-    //freopen("sample.data", "r", stdin);
-    freopen("myout.txt", "w", stdout);
-#endif
-    srand(time(0));
+static TRACE::PipelineTracer tracer;
+static size_t lanes = 4; //向量单元的通道数
+static bool earlyBranch = false; //条件分支在 ID 确定
+static bool loopBuffer = true, fusion = true; //循环缓冲与宏融合，默认开
 
-    CPU Yakumo_Ran(TWOLEVEL, FORWARDING);
+template<class Instrument>
+static int simulate(const std::string& program, bool traced, bool stats) {
+    std::unique_ptr<CPUCore<Instrument>> core;
+    try {
+        core.reset(new CPUCore<Instrument>(program, TWOLEVEL, FORWARDING, NONBLOCKING, 2, loopBuffer, fusion, lanes, earlyBranch));
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    CPUCore<Instrument>& Yakumo_Ran = *core;
+    if (traced) Yakumo_Ran.attachTracer(&tracer);
     Yakumo_Ran.run();
-    return 0;
-}
\ No newline at end of file
+    tracer.close();
+    if (stats) Yakumo_Ran.display();
+    return Yakumo_Ran.exitCode();
+}
+
+int main(int argc, char* argv[]) {
+
+    //--trace <file> 输出 Konata 流水线图, --trace-window <begin>:<end> 只记录这些周期(可多次指定)
+    //--stats 结束时在程序输出之后打印周期数、预测器与访存/预取统计、指令组成与热点
+    //--debug 逐周期打印各阶段结果与寄存器
+    //--lanes <n> 向量单元每周期处理的元素数 (1-16)，默认 4
+    //--early-branch 条件分支在 ID 用专门的比较器确定，预测错误只冲掉一条；--stats 中可对比预测错误的代价
+    //--no-loop-buffer / --no-fusion 关闭循环缓冲 / 宏融合，用来对比它们的效果
+    //--seed <n> 固定各阶段执行顺序的随机种子，周期数可以重现；默认按时间取
+    //不带这些选项时使用不插桩的引擎
+    //其余参数为程序文件的路径；不给出时从 stdin 读入程序，此时 stdin 已读到结尾，程序的 read 只会读到 EOF
+    std::string tracePath, programPath;
+    bool stats = false, debug = false;
+    unsigned seed = time(0);
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stats") stats = true;
+        else if (arg == "--debug") debug = true;
+        else if (arg == "--early-branch") earlyBranch = true;
+        else if (arg == "--no-loop-buffer") loopBuffer = false;
+        else if (arg == "--no-fusion") fusion = false;
+        else if (i + 1 < argc && arg == "--trace") tracePath = argv[++i];
+        else if (i + 1 < argc && arg == "--seed") seed = strtoul(argv[++i], nullptr, 10);
+        else if (i + 1 < argc && arg == "--lanes") {
+            lanes = strtoul(argv[++i], nullptr, 10);
+            if (lanes < 1 || lanes > VLMAX) {
+                std::cerr << "bad lanes: " << argv[i] << '\n';
+                return 1;
+            }
+        }
+        else if (i + 1 < argc && arg == "--trace-window") {
+            unsigned long long begin = 0, end = 0;
+            if (sscanf(argv[++i], "%llu:%llu", &begin, &end) != 2 || begin >= end) {
+                std::cerr << "bad trace window: " << argv[i] << '\n';
+                return 1;
+            }
+            tracer.addWindow(begin, end);
+        }
+        else programPath = arg;
+    }
+    srand(seed);
+    if (!tracePath.empty() && !tracer.open(tracePath)) {
+        std::cerr << "cannot open " << tracePath << '\n';
+        return 1;
+    }
+
+    //hex 文本或 ELF，给出路径时 stdin 留给程序的 read
+    std::string program;
+    if (programPath.empty()) program.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    else {
+        std::ifstream fin(programPath, std::ios::binary);
+        if (!fin) {
+            std::cerr << "cannot open " << programPath << '\n';
+            return 1;
+        }
+        program.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    }
+    bool traced = !tracePath.empty();
+    if (debug) return simulate<INSTRUMENT::DebugDump>(program, false, stats);
+    if (traced && stats) return simulate<INSTRUMENT::Combine<INSTRUMENT::KonataTrace, INSTRUMENT::Statistics>>(program, true, true);
+    if (traced) return simulate<INSTRUMENT::KonataTrace>(program, true, false);
+    if (stats) return simulate<INSTRUMENT::Statistics>(program, false, true);
+    return simulate<INSTRUMENT::Null>(program, false, false);
+}
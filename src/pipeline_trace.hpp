@@ -0,0 +1,218 @@
+#ifndef RISC_V_SIMULATOR_PIPELINE_TRACE_HPP
+#define RISC_V_SIMULATOR_PIPELINE_TRACE_HPP
+
+#include "include.hpp"
+#include "elf_loader.hpp"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace RISC_V {
+    namespace TRACE {
+        enum EventType {FETCH, STAGE, LABEL, STALL, RETIRE, FLUSH};
+
+        struct Event { //一条流水线事件, uid 为取指时分配的指令编号
+            uint64_t cycle;
+            uint32_t uid, pc, insCode;
+            uint8_t type, stage;
+        };
+
+        template<class T, size_t SIZE = (1 << 16)> //单生产者单消费者无锁环形队列, SIZE 为 2 的幂
+        class RingBuffer {
+        private:
+            static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of 2");
+            T buffer[SIZE];
+            alignas(64) std::atomic<size_t> head; //消费者
+            alignas(64) std::atomic<size_t> tail; //生产者
+        public:
+            RingBuffer() : head(0), tail(0) {}
+
+            bool push(const T& obj) {
+                size_t t = tail.load(std::memory_order_relaxed);
+                if (t - head.load(std::memory_order_acquire) == SIZE) return false; //full
+                buffer[t & (SIZE - 1)] = obj;
+                tail.store(t + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool pop(T& obj) {
+                size_t h = head.load(std::memory_order_relaxed);
+                if (h == tail.load(std::memory_order_acquire)) return false; //empty
+                obj = buffer[h & (SIZE - 1)];
+                head.store(h + 1, std::memory_order_release);
+                return true;
+            }
+        };
+
+        /*
+         * 以 Konata (Kanata 0004) 格式输出每条指令的生命周期
+         * CPU 线程只把 Event 压入环形队列，格式化与写文件由后台线程完成
+         * 可以指定若干个 [begin, end) 周期窗口，只记录窗口内的事件
+         */
+        class PipelineTracer {
+        private:
+            const char* stageName[5] = {"F", "Dc", "X", "M", "W"};
+
+            RingBuffer<Event> queue;
+            std::ofstream fout;
+            std::thread writer;
+            std::atomic<bool> running;
+            std::vector<std::pair<uint64_t, uint64_t>> windows; //按 begin 排序
+            size_t nowWindow;
+            const SymbolTable* symbols; //可选，用于显示函数名
+
+            //以下只在 writer 线程中使用
+            struct Record {
+                uint32_t fileId;
+                int stage;
+                bool labeled;
+            };
+            std::unordered_map<uint32_t, Record> alive;
+            std::unordered_set<uint32_t> dead;
+            std::vector<uint32_t> retirePending;
+            uint64_t lastCycle;
+            uint32_t fileIdCount, retireCount, maxUid;
+            bool started;
+
+            Record& lookup(const Event& e) {
+                auto it = alive.find(e.uid);
+                if (it != alive.end()) return it->second;
+                Record& r = alive[e.uid];
+                r.fileId = fileIdCount++, r.stage = -1, r.labeled = false;
+                if (e.uid > maxUid) maxUid = e.uid;
+                fout << "I\t" << r.fileId << '\t' << e.uid << "\t0\n";
+                fout << "L\t" << r.fileId << "\t0\t" << std::hex << std::setw(8) << std::setfill('0') << e.pc;
+                if (symbols && !symbols->empty()) fout << " <" << symbols->lookup(e.pc) << '>';
+                fout << ": " << std::setw(8) << e.insCode << std::dec << std::setfill(' ') << '\n';
+                return r;
+            }
+
+            void finish(uint32_t uid, bool flush) {
+                auto it = alive.find(uid);
+                if (it == alive.end()) return;
+                fout << "R\t" << it->second.fileId << '\t' << retireCount++ << '\t' << flush << '\n';
+                alive.erase(it);
+                dead.insert(uid);
+            }
+
+            void advance(uint64_t cycle) {
+                if (!started) {
+                    fout << "C=\t" << cycle << '\n';
+                    started = true, lastCycle = cycle;
+                    return;
+                }
+                if (cycle <= lastCycle) return;
+                fout << "C\t" << cycle - lastCycle << '\n';
+                lastCycle = cycle;
+                for (uint32_t uid : retirePending) finish(uid, false); //W 阶段至少显示一个周期
+                retirePending.clear();
+                if (dead.size() > 4096) { //只需记住最近结束的指令
+                    for (auto it = dead.begin(); it != dead.end();)
+                        it = (*it + 1024 < maxUid) ? dead.erase(it) : std::next(it);
+                }
+            }
+
+            void handle(const Event& e) {
+                advance(e.cycle);
+                if (!e.uid || dead.count(e.uid)) return;
+                Record& r = lookup(e);
+                switch (e.type) {
+                    case FETCH:
+                    case STAGE:
+                        if (r.stage == e.stage) break; //stall 时同一阶段会被重复执行
+                        r.stage = e.stage;
+                        fout << "S\t" << r.fileId << "\t0\t" << stageName[e.stage] << '\n';
+                        break;
+                    case LABEL:
+                        if (r.labeled) break; //L 命令是追加文本，重复解码只记一次
+                        r.labeled = true;
+                        fout << "L\t" << r.fileId << "\t0\t " << insName[e.insCode] << '\n';
+                        break;
+                    case STALL:
+                        fout << "L\t" << r.fileId << "\t1\t" << (e.stage == MEM_Stage ? "memory" : "data hazard")
+                             << " stall @" << e.cycle << '\n';
+                        break;
+                    case RETIRE:
+                        retirePending.push_back(e.uid);
+                        break;
+                    case FLUSH:
+                        finish(e.uid, true);
+                        break;
+                }
+            }
+
+            void drain() {
+                Event e;
+                while (queue.pop(e)) handle(e);
+            }
+
+            void work() {
+                while (running.load(std::memory_order_acquire)) {
+                    Event e;
+                    if (queue.pop(e)) handle(e);
+                    else std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                drain();
+                advance(lastCycle + 1);
+                std::vector<uint32_t> rest;
+                for (auto& it : alive) rest.push_back(it.first);
+                std::sort(rest.begin(), rest.end());
+                for (uint32_t uid : rest) finish(uid, true); //窗口结束时仍在流水线中的指令
+                fout.flush();
+            }
+
+        public:
+            bool on; //当前周期是否记录，由 CPU 每周期刷新
+
+            PipelineTracer() : running(false), nowWindow(0), symbols(nullptr), lastCycle(0), fileIdCount(0), retireCount(0),
+                               maxUid(0), started(false), on(false) {}
+
+            ~PipelineTracer() { close(); }
+
+            void setSymbols(const SymbolTable* _symbols) { symbols = _symbols; }
+
+            void addWindow(uint64_t begin, uint64_t end) {
+                windows.push_back(std::make_pair(begin, end));
+                std::sort(windows.begin(), windows.end());
+            }
+
+            bool open(const std::string& path) {
+                fout.open(path);
+                if (!fout) return false;
+                if (windows.empty()) addWindow(0, UINT64_MAX);
+                fout << "Kanata\t0004\n";
+                running = true;
+                writer = std::thread(&PipelineTracer::work, this);
+                return true;
+            }
+
+            void close() {
+                if (!running) return;
+                running = false;
+                writer.join();
+                fout.close();
+            }
+
+            void tick(uint64_t cycle) { //每周期调用一次，窗口外 on 为 false，流水线中只剩一次分支判断
+                on = false;
+                if (!running) return;
+                while (nowWindow < windows.size() && cycle >= windows[nowWindow].second) nowWindow++;
+                on = nowWindow < windows.size() && cycle >= windows[nowWindow].first;
+            }
+
+            void record(EventType type, uint64_t cycle, uint32_t uid, uint32_t pc = 0, uint32_t insCode = 0,
+                        StageType stage = IF_Stage) {
+                if (!uid) return;
+                Event e = {cycle, uid, pc, insCode, uint8_t(type), uint8_t(stage)};
+                while (!queue.push(e)) std::this_thread::yield(); //满时等待 writer，不丢事件
+            }
+        };
+    }
+}
+
+#endif //RISC_V_SIMULATOR_PIPELINE_TRACE_HPP
@@ -0,0 +1,166 @@
+#ifndef RISC_V_SIMULATOR_SIMD_HPP
+#define RISC_V_SIMULATOR_SIMD_HPP
+
+#include "include.hpp"
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+namespace RISC_V {
+    /*
+     * 向量单元在宿主机上的实现：n 个 32 位元素的逐元素运算、归约，以及内存池(一个单元一个字节)与字之间的转换
+     * 编译时有 AVX2 就每次 8 个元素，只有 SSE4.1 就每次 4 个，剩下的(以及都没有时)逐个算
+     * 只写前 n 个元素，n 之后的保持不变 (tail undisturbed)
+     */
+    namespace SIMD {
+        enum Op {ADD, SUB, RSUB, AND, OR, XOR, SLL, SRL, SRA, MIN, MINU, MAX, MAXU, MUL};
+
+        static uint32_t scalar(Op op, uint32_t a, uint32_t b) {
+            switch (op) {
+                case ADD: return a + b;
+                case SUB: return a - b;
+                case RSUB: return b - a;
+                case AND: return a & b;
+                case OR: return a | b;
+                case XOR: return a ^ b;
+                case SLL: return a << (b & 31);
+                case SRL: return a >> (b & 31);
+                case SRA: return uint32_t(int32_t(a) >> (b & 31));
+                case MIN: return int32_t(a) < int32_t(b) ? a : b;
+                case MINU: return a < b ? a : b;
+                case MAX: return int32_t(a) > int32_t(b) ? a : b;
+                case MAXU: return a > b ? a : b;
+                case MUL: return a * b;
+            }
+            return 0;
+        }
+
+#if defined(__AVX2__)
+        static bool vector8(Op op, __m256i a, __m256i b, __m256i& r) {
+            const __m256i mask = _mm256_set1_epi32(31);
+            switch (op) {
+                case ADD: r = _mm256_add_epi32(a, b); break;
+                case SUB: r = _mm256_sub_epi32(a, b); break;
+                case RSUB: r = _mm256_sub_epi32(b, a); break;
+                case AND: r = _mm256_and_si256(a, b); break;
+                case OR: r = _mm256_or_si256(a, b); break;
+                case XOR: r = _mm256_xor_si256(a, b); break;
+                case SLL: r = _mm256_sllv_epi32(a, _mm256_and_si256(b, mask)); break;
+                case SRL: r = _mm256_srlv_epi32(a, _mm256_and_si256(b, mask)); break;
+                case SRA: r = _mm256_srav_epi32(a, _mm256_and_si256(b, mask)); break;
+                case MIN: r = _mm256_min_epi32(a, b); break;
+                case MINU: r = _mm256_min_epu32(a, b); break;
+                case MAX: r = _mm256_max_epi32(a, b); break;
+                case MAXU: r = _mm256_max_epu32(a, b); break;
+                case MUL: r = _mm256_mullo_epi32(a, b); break;
+            }
+            return true;
+        }
+#endif
+
+#if defined(__SSE4_1__)
+        static bool vector4(Op op, __m128i a, __m128i b, __m128i& r) { //SSE 没有按元素的移位
+            switch (op) {
+                case ADD: r = _mm_add_epi32(a, b); break;
+                case SUB: r = _mm_sub_epi32(a, b); break;
+                case RSUB: r = _mm_sub_epi32(b, a); break;
+                case AND: r = _mm_and_si128(a, b); break;
+                case OR: r = _mm_or_si128(a, b); break;
+                case XOR: r = _mm_xor_si128(a, b); break;
+                case MIN: r = _mm_min_epi32(a, b); break;
+                case MINU: r = _mm_min_epu32(a, b); break;
+                case MAX: r = _mm_max_epi32(a, b); break;
+                case MAXU: r = _mm_max_epu32(a, b); break;
+                case MUL: r = _mm_mullo_epi32(a, b); break;
+                default: return false;
+            }
+            return true;
+        }
+#endif
+
+        static void binary(Op op, uint32_t* d, const uint32_t* a, const uint32_t* b, size_t n) { //d[i] = a[i] op b[i]
+            size_t i = 0;
+#if defined(__AVX2__)
+            for (__m256i r; i + 8 <= n; i += 8) {
+                vector8(op, _mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)), r);
+                _mm256_storeu_si256((__m256i*)(d + i), r);
+            }
+#endif
+#if defined(__SSE4_1__)
+            for (__m128i r; i + 4 <= n; i += 4) {
+                if (!vector4(op, _mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)), r)) break;
+                _mm_storeu_si128((__m128i*)(d + i), r);
+            }
+#endif
+            for (; i < n; ++i) d[i] = scalar(op, a[i], b[i]);
+        }
+
+        static void binary(Op op, uint32_t* d, const uint32_t* a, uint32_t x, size_t n) { //d[i] = a[i] op x
+            alignas(32) uint32_t splat[64];
+            for (size_t i = 0; i < n; i += 64) {
+                size_t m = std::min(n - i, size_t(64));
+                std::fill(splat, splat + m, x);
+                binary(op, d + i, a + i, splat, m);
+            }
+        }
+
+        static uint32_t reduce(Op op, const uint32_t* a, size_t n, uint32_t init) { //init op a[0] op ... op a[n-1]
+            size_t i = 0;
+#if defined(__AVX2__)
+            if (n >= 16) {
+                __m256i acc = _mm256_loadu_si256((const __m256i*)a);
+                for (i = 8; i + 8 <= n; i += 8) vector8(op, acc, _mm256_loadu_si256((const __m256i*)(a + i)), acc);
+                alignas(32) uint32_t part[8];
+                _mm256_store_si256((__m256i*)part, acc);
+                for (int j = 0; j < 8; ++j) init = scalar(op, init, part[j]);
+            }
+#endif
+            for (; i < n; ++i) init = scalar(op, init, a[i]);
+            return init;
+        }
+
+        static void packBytes(const uint32_t* pool, uint32_t* words, size_t n) { //内存池中 4n 个字节 -> n 个小端字
+            size_t i = 0;
+#if defined(__AVX2__)
+            const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7); //pack 按 128 位分半进行，重新排列
+            for (; i + 8 <= n; i += 8) {
+                const __m256i* p = (const __m256i*)(pool + 4 * i);
+                __m256i lo = _mm256_packus_epi32(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1));
+                __m256i hi = _mm256_packus_epi32(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3));
+                __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), order);
+                _mm256_storeu_si256((__m256i*)(words + i), bytes);
+            }
+#endif
+#if defined(__SSE4_1__)
+            for (; i + 4 <= n; i += 4) {
+                const __m128i* p = (const __m128i*)(pool + 4 * i);
+                __m128i lo = _mm_packus_epi32(_mm_loadu_si128(p), _mm_loadu_si128(p + 1));
+                __m128i hi = _mm_packus_epi32(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3));
+                _mm_storeu_si128((__m128i*)(words + i), _mm_packus_epi16(lo, hi));
+            }
+#endif
+            for (; i < n; ++i) {
+                const uint32_t* p = pool + 4 * i;
+                words[i] = p[0] | p[1] << 8 | p[2] << 16 | p[3] << 24;
+            }
+        }
+
+        static void unpackBytes(const uint32_t* words, uint32_t* pool, size_t n) { //n 个字 -> 内存池中 4n 个字节
+            size_t i = 0;
+#if defined(__SSE4_1__)
+            for (; i + 4 <= n; i += 4) {
+                __m128i bytes = _mm_loadu_si128((const __m128i*)(words + i));
+                __m128i* p = (__m128i*)(pool + 4 * i);
+                _mm_storeu_si128(p, _mm_cvtepu8_epi32(bytes));
+                _mm_storeu_si128(p + 1, _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4)));
+                _mm_storeu_si128(p + 2, _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+                _mm_storeu_si128(p + 3, _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12)));
+            }
+#endif
+            for (; i < n; ++i)
+                for (int j = 0; j < 4; ++j) pool[4 * i + j] = (words[i] >> (8 * j)) & 255;
+        }
+    }
+}
+
+#endif //RISC_V_SIMULATOR_SIMD_HPP
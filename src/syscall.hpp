@@ -0,0 +1,136 @@
+#ifndef RISC_V_SIMULATOR_SYSCALL_HPP
+#define RISC_V_SIMULATOR_SYSCALL_HPP
+
+#include "basic_components.hpp"
+#include <cstdio>
+#include <vector>
+
+namespace RISC_V {
+    /*
+     * ECALL 系统调用模拟，调用号与参数约定同 newlib (libgloss/riscv)：
+     * a7 调用号, a0-a2 参数, a0 返回值, 出错返回 -errno
+     * 客户程序的输出先攒在缓冲区里，满了或退出时再一次性写到宿主机
+     * 标准输入输出默认为 std::cin / std::cout，可用 setIO 换成任意流（嵌入使用时）
+     */
+    class SyscallHandler {
+    public:
+        enum Number {
+            SYS_CLOSE = 57, SYS_LSEEK = 62, SYS_READ = 63, SYS_WRITE = 64, SYS_FSTAT = 80,
+            SYS_EXIT = 93, SYS_EXIT_GROUP = 94, SYS_TIMES = 153, SYS_GETTIMEOFDAY = 169, SYS_BRK = 214
+        };
+
+        static const uint32_t CLOCK_HZ = 100000000; //模拟时钟频率 100MHz，用于换算时间
+        static const size_t BUFFER_SIZE = 1 << 16, STACK_RESERVE = 1 << 16; //brk 不能侵入栈顶的 64KB
+
+        bool exited;
+        uint32_t exitCode;
+
+        SyscallHandler() : exited(false), exitCode(0), programBreak(0), breakBase(0), in(&std::cin), out(&std::cout) {
+            buffer[0].reserve(BUFFER_SIZE), buffer[1].reserve(BUFFER_SIZE);
+        }
+
+        ~SyscallHandler() { flush(); }
+
+        void setBreak(uint32_t end) { programBreak = breakBase = (end + 15) & ~15u; }
+
+        void setIO(std::istream* _in, std::ostream* _out) {
+            flush();
+            in = _in, out = _out;
+        }
+
+        std::ostream& output() { return *out; }
+
+        void reset() { //未写出的输出照常写出
+            flush();
+            exited = false, exitCode = 0;
+            programBreak = breakBase;
+        }
+
+        uint32_t call(BASIC::Memory& mem, size_t tick, uint32_t num, uint32_t a0, uint32_t a1, uint32_t a2) {
+            switch (num) {
+                case SYS_WRITE: {
+                    if (a0 != 1 && a0 != 2) return -ERR_BADF;
+                    if (!valid(a1, a2)) return -ERR_FAULT;
+                    std::vector<char>& buf = buffer[a0 - 1];
+                    for (uint32_t i = 0; i < a2; ++i) {
+                        buf.push_back(char(mem.read(a1 + i)));
+                        if (buf.size() >= BUFFER_SIZE) flush(a0);
+                    }
+                    if (a0 == 2) flush(1), flush(2); //stderr 不缓冲，顺带保持与 stdout 的先后顺序
+                    return a2;
+                }
+                case SYS_READ: {
+                    if (a0 != 0) return -ERR_BADF;
+                    if (!valid(a1, a2)) return -ERR_FAULT;
+                    flush(1); //交互式程序先看到提示再输入
+                    uint32_t cnt = 0;
+                    for (int ch; cnt < a2 && (ch = in->get()) != EOF;) {
+                        mem.write(a1 + cnt++, uint8_t(ch));
+                        if (ch == '\n') break;
+                    }
+                    return cnt;
+                }
+                case SYS_FSTAT: {
+                    if (a0 > 2) return -ERR_BADF;
+                    if (!valid(a1, 128)) return -ERR_FAULT;
+                    for (uint32_t i = 0; i < 128; ++i) mem.write(a1 + i, 0); //struct kernel_stat
+                    mem.write(a1 + 16, 0020620, 4); //st_mode: S_IFCHR | 0620，标准流都视为终端
+                    mem.write(a1 + 56, 4096, 4); //st_blksize
+                    return 0;
+                }
+                case SYS_CLOSE:
+                    return a0 > 2 ? -ERR_BADF : 0;
+                case SYS_LSEEK:
+                    return a0 > 2 ? -ERR_BADF : -ERR_SPIPE;
+                case SYS_EXIT:
+                case SYS_EXIT_GROUP:
+                    exited = true, exitCode = a0;
+                    flush();
+                    return a0;
+                case SYS_BRK: {
+                    if (a0 >= breakBase && a0 + STACK_RESERVE <= MEM_SIZE) programBreak = a0;
+                    return programBreak; //失败时返回原来的 break，与 Linux 一致
+                }
+                case SYS_GETTIMEOFDAY: {
+                    if (!valid(a0, 16)) return -ERR_FAULT;
+                    uint64_t usec = uint64_t(tick) * 1000000 / CLOCK_HZ;
+                    mem.write(a0, uint32_t(usec / 1000000), 4); //tv_sec, 64-bit time_t
+                    mem.write(a0 + 4, 0, 4);
+                    mem.write(a0 + 8, uint32_t(usec % 1000000), 4); //tv_usec
+                    return 0;
+                }
+                case SYS_TIMES: { //struct tms, 单位为 CLOCKS_PER_SEC (newlib 为 1000)
+                    if (!valid(a0, 16)) return -ERR_FAULT;
+                    uint32_t ms = uint64_t(tick) * 1000 / CLOCK_HZ;
+                    mem.write(a0, ms, 4);
+                    for (uint32_t i = 4; i < 16; ++i) mem.write(a0 + i, 0);
+                    return ms;
+                }
+            }
+            return -ERR_NOSYS;
+        }
+
+        void flush() { flush(1), flush(2); }
+
+    private:
+        enum Errno {ERR_BADF = 9, ERR_FAULT = 14, ERR_SPIPE = 29, ERR_NOSYS = 38};
+
+        std::vector<char> buffer[2]; //stdout, stderr
+        uint32_t programBreak, breakBase;
+        std::istream* in;
+        std::ostream* out;
+
+        static bool valid(uint32_t addr, uint32_t len) { return size_t(addr) + len <= MEM_SIZE; }
+
+        void flush(uint32_t fd) {
+            std::vector<char>& buf = buffer[fd - 1];
+            if (buf.empty()) return;
+            std::ostream& os = fd == 1 ? *out : std::cerr;
+            os.write(buf.data(), buf.size());
+            os.flush();
+            buf.clear();
+        }
+    };
+}
+
+#endif //RISC_V_SIMULATOR_SYSCALL_HPP
@@ -0,0 +1,150 @@
+import argparse
+import os
+import re
+import subprocess
+import tempfile
+
+import genWorkload
+
+# 用 genWorkload 生成的合成负载扫描参数，每次只改一个、其余取 genWorkload.defaults，
+# 用模拟器的 --stats 输出整理出 CPI 等指标，写成 markdown 表格
+# lanes 一项比较 genWorkload 向量核的标量与 RVV 写法，得到不同通道数下向量单元的加速比
+# resolve 一项在不同的分支模式周期下比较条件分支在 EX 与 ID (--early-branch) 确定时预测错误冲掉的指令数
+# 模拟器需先编译好 (cmake 生成的 code)
+
+simulator = './code'
+seed = 1  # 模拟器的 --seed，固定各阶段的执行顺序，表格可以重现
+out_path = 'performance/cpi_sweep.md'
+
+sweeps = {
+    'chain': [1, 2, 4, 8],  # 依赖链越长，前传也救不了的停顿越多
+    'load_use': [0, 1, 2, 4],  # load 结果隔几条指令才用
+    'taken_rate': [0.0, 0.25, 0.5, 0.75, 1.0],
+    'period': [1, 2, 4, 8, 16, 32],  # 分支模式的周期，考验预测器的历史长度
+    'branches': [0, 1, 2, 4],
+    'stride': [0, 4, 16, 64, 256],  # 目前没有数据 cache，只影响 store 到 load 的转发
+    'footprint': [8, 256, 4096, 65536, 262144],
+    'code_size': [0, 32, 128, 512, 2048],  # 循环体超过 32 条时循环缓冲不再起作用
+}
+
+# 扫描某个参数时一并改掉的其他参数：period 为默认的 2 时 taken_rate 只能取到 0、0.5、1
+pinned = {
+    'taken_rate': {'period': 8},
+}
+
+lanes = [1, 2, 4, 8, 16]  # 模拟器的 --lanes
+
+extra = ['lanes', 'resolve']  # 不属于 genWorkload 参数的扫描
+
+metrics = [  # 表头, --stats 中的正则
+    ('CPI', r'CPI: ([\d.]+)'),
+    ('Cycles', r'Total Tick: (\d+)'),
+    ('Instructions', r'Instructions: (\d+)'),
+    ('Data Hazard', r'Data Hazard: (\d+)'),
+    ('Predict Rate', r'Success Rate:([\d.]+)'),
+    ('ICache Miss', r'ICache Miss:(\d+)'),
+    ('Forwarded Loads', r'Forwarded Loads:(\d+)'),
+]
+
+
+def run(text, args=()):  # 返回 --stats 的输出
+    fd, path = tempfile.mkstemp(suffix='.data')
+    try:
+        with os.fdopen(fd, 'w') as f:
+            f.write(text)
+        with open(path) as f:
+            return subprocess.run([simulator, '--stats', '--seed', str(seed)] + list(args), stdin=f, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    finally:
+        os.remove(path)
+
+
+def measure(params):
+    out = run(genWorkload.to_hex(genWorkload.generate(**params)))
+    row = []
+    for _, pattern in metrics:
+        m = re.search(pattern, out)
+        row.append(m.group(1) if m else '-')
+    return row
+
+
+def lane_sweep(kernel):
+    def cycles(vector, args=()):
+        code, data = genWorkload.generate_kernel(**dict(kernel, vector=vector))
+        out = run(genWorkload.to_hex(code, data=data), args)
+        return int(re.search(r'Total Tick: (\d+)', out).group(1)), int(re.search(r'Instructions: (\d+)', out).group(1))
+
+    scalar, scalar_ins = cycles(0)
+    lines = ['### lanes', '', '向量核 y[i] += x[i] << 2，' + ', '.join('%s=%s' % (k, v) for k, v in kernel.items() if k != 'vector')
+             + '；标量写法 %d 周期、%d 条指令' % (scalar, scalar_ins), '',
+             '| lanes | Vector Cycles | Vector Instructions | Speedup |', '| :----: ' * 4 + '|']
+    for n in lanes:
+        vector, vector_ins = cycles(1, ['--lanes', str(n)])
+        lines.append('| %d | %d | %d | %.2f |' % (n, vector, vector_ins, scalar / vector))
+    lines.append('')
+    return lines
+
+
+def resolve_sweep(base):
+    def stats(params, args=()):
+        out = run(genWorkload.to_hex(genWorkload.generate(**params)), args)
+        return [int(re.search(pattern, out).group(1)) for pattern in
+                (r'Total Tick: (\d+)', r'Wrong:(\d+)', r'Mispredict Penalty:(\d+)')]
+
+    lines = ['### resolve', '', '条件分支在 EX 确定 (默认) 与在 ID 确定 (--early-branch)，按 period 扫描；Squashed 为预测错误时实际冲掉的错误路径指令数', '',
+             '| period | EX Cycles | EX Mispredicts | EX Squashed | ID Cycles | ID Mispredicts | ID Squashed |', '| :----: ' * 7 + '|']
+    for value in sweeps['period']:
+        params = dict(base, period=value)
+        row = stats(params) + stats(params, ['--early-branch'])
+        lines.append('| %d | ' % value + ' | '.join(map(str, row)) + ' |')
+    lines.append('')
+    return lines
+
+
+def label(name, value, params):  # taken_rate 附上实际的跳转比例 k/period
+    if name != 'taken_rate':
+        return str(value)
+    k = bin(genWorkload.pattern_bits(value, params['period'])).count('1')
+    return '%s (%d/%d)' % (value, k, params['period'])
+
+
+def sweep(names, base):
+    lines = ['## 合成负载 CPI 扫描', '', '基准参数：' + ', '.join('%s=%s' % (k, v) for k, v in base.items()), '']
+    for name in names:
+        print('sweep ' + name)
+        if name == 'lanes':
+            lines += lane_sweep(genWorkload.kernel_defaults)
+            continue
+        if name == 'resolve':
+            lines += resolve_sweep(base)
+            continue
+        lines.append('### ' + name)
+        if name in pinned:
+            lines += ['', '扫描时 ' + ', '.join('%s=%s' % (k, v) for k, v in pinned[name].items()), '']
+        lines.append('| ' + name + ' | ' + ' | '.join(m[0] for m in metrics) + ' |')
+        lines.append('| :----: ' * (len(metrics) + 1) + '|')
+        for value in sweeps[name]:
+            params = dict(base, **pinned.get(name, {}))
+            params[name] = value
+            lines.append('| ' + label(name, value, params) + ' | ' + ' | '.join(measure(params)) + ' |')
+        lines.append('')
+    return '\n'.join(lines)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='sweep synthetic workload parameters and tabulate CPI')
+    parser.add_argument('params', nargs='*', help='parameters to sweep (%s), all by default' % ', '.join(list(sweeps) + extra))
+    parser.add_argument('-s', '--simulator', default=simulator)
+    parser.add_argument('-o', '--output', default=out_path)
+    parser.add_argument('-n', '--iterations', type=int, default=genWorkload.defaults['iterations'])
+    parser.add_argument('--seed', type=int, default=seed)
+    args = parser.parse_args()
+    for name in args.params:
+        if name not in sweeps and name not in extra:
+            parser.error('unknown parameter ' + name)
+    simulator, seed = args.simulator, args.seed
+    base = dict(genWorkload.defaults)
+    base['iterations'] = args.iterations
+    text = sweep(args.params or list(sweeps) + extra, base)
+    with open(args.output, 'w') as f:
+        f.write(text)
+    print(text)
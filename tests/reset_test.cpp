@@ -0,0 +1,89 @@
+//
+// 同一个 CPU 把同一个程序跑两遍 (中间 reset)，两遍的寄存器、内存与周期数必须完全一致
+// 用法: reset_test program.data
+//
+
+#include "cpu_core.hpp"
+#include <fstream>
+#include <vector>
+#include <memory>
+
+namespace {
+    using namespace RISC_V;
+
+    const unsigned SEED = 2021; //各阶段的执行顺序由 rand 打乱，两遍用同一个种子
+
+    struct Snapshot {
+        StopType stop;
+        size_t cycles, instructions;
+        uint32_t pc;
+        std::vector<uint32_t> regs, words;
+    };
+
+    Snapshot snapshot(const CPU& cpu, StopType stop) {
+        Snapshot s = {stop, cpu.cycles(), cpu.instructions(), cpu.fetchPC(), {}, {}};
+        for (size_t i = 0; i < REG_N; ++i) s.regs.push_back(cpu.readReg(i));
+        for (size_t addr = 0; addr + 4 <= MEM_SIZE; addr += 4) s.words.push_back(cpu.readMem(addr, 4));
+        return s;
+    }
+
+    std::vector<Snapshot> runOnce(CPU& cpu) { //step、各种 runUntil 交替推进，每次停下记录一次状态
+        std::vector<Snapshot> ret;
+        srand(SEED);
+        cpu.step();
+        cpu.step(99);
+        ret.push_back(snapshot(cpu, STOP_CYCLE));
+        ret.push_back(snapshot(cpu, cpu.runUntil(STOP_CYCLE, 5000)));
+        uint32_t pc = cpu.lastRetiredPC(); //循环中的一条，之后还会再提交
+        ret.push_back(snapshot(cpu, cpu.runUntil(STOP_PC, pc)));
+        ret.push_back(snapshot(cpu, cpu.runUntil(STOP_PC, pc)));
+        ret.push_back(snapshot(cpu, cpu.runUntil(STOP_HALT)));
+        return ret;
+    }
+
+    int compare(const std::vector<Snapshot>& a, const std::vector<Snapshot>& b) {
+        int bad = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (a[i].stop != b[i].stop || a[i].cycles != b[i].cycles || a[i].instructions != b[i].instructions || a[i].pc != b[i].pc) {
+                std::cerr << "stop " << i << ": cycles " << a[i].cycles << " vs " << b[i].cycles << ", instructions "
+                          << a[i].instructions << " vs " << b[i].instructions << '\n';
+                bad++;
+            }
+            for (size_t r = 0; r < REG_N; ++r)
+                if (a[i].regs[r] != b[i].regs[r]) std::cerr << "stop " << i << ": x" << r << " differs\n", bad++;
+            for (size_t w = 0; w < a[i].words.size(); ++w)
+                if (a[i].words[w] != b[i].words[w]) {
+                    std::cerr << "stop " << i << ": memory at " << std::hex << w * 4 << std::dec << " differs\n", bad++;
+                    break;
+                }
+        }
+        return bad;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " program.data\n";
+        return 2;
+    }
+    std::ifstream fin(argv[1]);
+    if (!fin) {
+        std::cerr << "cannot open " << argv[1] << '\n';
+        return 2;
+    }
+    std::string program((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+    std::unique_ptr<CPU> cpu(new CPU(program, ADVANCED::TWOLEVEL, ADVANCED::FORWARDING));
+    std::istringstream in;
+    std::ostringstream out;
+    cpu->setIO(in, out);
+    Snapshot start = snapshot(*cpu, STOP_CYCLE);
+    std::vector<Snapshot> first = runOnce(*cpu);
+    cpu->reset();
+    int bad = compare({start}, {snapshot(*cpu, STOP_CYCLE)}); //reset 回到刚载入的状态
+    std::vector<Snapshot> second = runOnce(*cpu);
+    bad += compare(first, second);
+    if (first.back().stop != STOP_HALT || first[2].stop != STOP_PC) std::cerr << "program did not reach the expected stops\n", bad++;
+    std::cout << (bad ? "FAIL" : "PASS") << ": " << first.back().cycles << " cycles, " << first.back().instructions << " instructions\n";
+    return bad ? 1 : 0;
+}